@@ -2,50 +2,235 @@
 #include "ArcSpline.h"
 
 #include <algorithm>
+#include <deque>
+#include <functional>
 
 #include "FreeformLine.h"
+#include "FreeformLineSection.h"
 #include "Geometry.h"
 #include "ArcSplineUtil.h"
+#include "Instrumentation.h"
+#include "MonotonicArena.h"
+#include "ThreadPool.h"
+
+// Biarc result buffers of a thread, reused by all its passes. Passes nested within parallelFor() take buffers after those in use; the deque keeps buffers in place as it grows.
+struct BiarcBuffers
+{
+	std::deque<std::vector<Biarc>> buffers;
+	size_t numInUse = 0;
+};
+static thread_local BiarcBuffers t_biarcBuffers;
 
 ArcSpline::ArcSpline(const FreeformLine* line, ArcSplineUtil::ProcessingInput* processingInput /*= new ArcSplineUtil::ProcessingInput()*/) : sourceLine(line)
 {
 	recreateSpline(processingInput);
 }
 
-void ArcSpline::recreateSpline(ArcSplineUtil::ProcessingInput* processingInput /*= nullptr*/)
+ArcSpline::ArcSpline(const FreeformLine* line, ArcSplineUtil::ProcessingInput* processingInput, const SplineResult& result) : sourceLine(line), processingInput(processingInput)
+{
+	setResult(result);
+}
+
+bool ArcSpline::recreateSpline(ArcSplineUtil::ProcessingInput* processingInput /*= nullptr*/, const CancellationToken* cancellation /*= nullptr*/)
 {
 	if (processingInput) this->processingInput = processingInput;
 	ME_ASSERT(this->processingInput);
 
-	// Clear this
-	debugCorners.clear();
-	displayShapes.clear();
+	// Start an empty result
+	results.forgetFrozen();
+	SplineResult* result = results.beginResult(0, 0);
+	liveFrozenT = 0.0f;
+	numLiveFrozenShapes = numLiveFrozenCorners = 0;
+	ME_ON_INSTRUMENTATION(stats.clear());
+	ME_SCOPED_STATS(&stats);
+	MonotonicArena::Scope scratch;
+
+	// Generate splines; the source line is only read, tangent clipping state lives in line sections
+	const FreeformLine& line = *sourceLine;
+	ArenaVector<Range> cornersAndSegments(scratch.getArena());
+	findCornersAndSegments(line, &cornersAndSegments);
+	if (cancellation && cancellation->isCancelled()) { return false; }
+	const bool isDone = generateBiarcsAndFinalShapes(line, Range(0.0f, line.length()), &cornersAndSegments, &result->debugCorners, &result->displayShapes, cancellation);
+	ME_ON_INSTRUMENTATION(Instrumentation::addToGlobalStats(stats));
+	if (isDone) { results.publishResult(0, 0); }
+	return isDone;
+}
+
+void ArcSpline::updateLiveSpline()
+{
+	ME_ASSERT(this->processingInput);
+	ME_ON_INSTRUMENTATION(stats.clear());
+	ME_SCOPED_STATS(&stats);
+	MonotonicArena::Scope scratch;
+	const ArcSplineUtil::CornersInput& cornersInput = processingInput->corners;
+	const float length = sourceLine->length();
+	const float h = sourceLine->halfSmoothingSpread;
+
+	// Start with the frozen part of the published result
+	SplineResult* result = results.beginResult(numLiveFrozenShapes, numLiveFrozenCorners);
+	if (length <= liveFrozenT) { results.publishResult(numLiveFrozenShapes, numLiveFrozenCorners); return; }
+
+	// Corner detection at 't' looks ahead by the outer measurement point, tangent smoothing & end clipping. Corners farther from the end are final.
+	const float stableDist = (cornersInput.outerInterMeasurementFactor + 3.0f * cornersInput.innerInterMeasurementFactor + 3.0f) * h + cornersInput.tStep;
+	// Rescan a bit before the frozen point, so tangents clipped at the window start don't affect corners after it. Align with the full-line scan grid.
+	const float lookBack = (cornersInput.outerInterMeasurementFactor + 3.0f * cornersInput.innerInterMeasurementFactor + 4.0f) * h;
+	const float windowStart = std::fmax(0.0f, std::floor((liveFrozenT - lookBack) / cornersInput.tStep) * cornersInput.tStep);
+	// Corners found this close after the frozen point are the frozen corner itself, drifted during refinement
+	const float duplicateDist = liveFrozenT > 0.0f ? 2.0f * cornersInput.innerInterMeasurementFactor * h + cornersInput.maxDistBetweenCornersToMerge + cornersInput.tStep : 0.0f;
+
+	// Find corners & segments of the tail. Only the window is scanned, which keeps the update cost independent of the line length.
+	const FreeformLine& line = *sourceLine;
+	ArenaVector<Range> corners(scratch.getArena()), markers(scratch.getArena());
+	{
+		ME_STAGE_TIMER(STAGE_FIND_CORNERS);
+		FreeformLineSection window(line, Range(windowStart, length), !cornersInput.coarseToFine, scratch.getArena());
+		ArcSplineUtil::findCorners(window, cornersInput, &corners);
+		corners.erase(std::remove_if(corners.begin(), corners.end(), [&](const Range& c) { return c.start < liveFrozenT + duplicateDist; }), corners.end());
+	}
+	findSegmentsBetweenCorners(line, Range(liveFrozenT, length), &corners, &markers);
+
+	// Freeze the tail up to the last final corner, or split it when it grows too long
+	float freezeT = liveFrozenT;
+	for (const Range& c : corners) { if (c.end <= length - stableDist) { freezeT = c.end; } }
+	if (length - stableDist - freezeT > maxLiveTailLength) { freezeT = length - stableDist; }
+
+	// Generate shapes for the newly frozen part, then for the tail
+	if (liveFrozenT < freezeT)
+	{
+		ArenaVector<Range> frozenMarkers(scratch.getArena());
+		for (const Range& m : markers)
+		{
+			if (m.start < freezeT || (m.length() == 0.0f && m.start == freezeT)) { frozenMarkers.push_back(Range(m.start, std::fmin(m.end, freezeT))); }
+		}
+		generateBiarcsAndFinalShapes(line, Range(liveFrozenT, freezeT), &frozenMarkers, &result->debugCorners, &result->displayShapes);
+
+		liveFrozenT = freezeT;
+		numLiveFrozenCorners = result->debugCorners.size();
+		numLiveFrozenShapes = result->displayShapes.size();
+	}
+
+	ArenaVector<Range> tailMarkers(scratch.getArena());
+	for (const Range& m : markers)
+	{
+		if (m.end > liveFrozenT) { tailMarkers.push_back(Range(std::fmax(m.start, liveFrozenT), m.end)); }
+	}
+	generateBiarcsAndFinalShapes(line, Range(liveFrozenT, length), &tailMarkers, &result->debugCorners, &result->displayShapes);
+	ME_ON_INSTRUMENTATION(Instrumentation::addToGlobalStats(stats));
+	results.publishResult(numLiveFrozenShapes, numLiveFrozenCorners);
+}
 
-	// Make non-const copy of input
-	FreeformLine lineCopy = *sourceLine;
+void ArcSpline::setResult(const SplineResult& result)
+{
+	results.forgetFrozen();
+	SplineResult* copy = results.beginResult(0, 0);
+	copy->displayShapes = result.displayShapes;
+	copy->debugCorners = result.debugCorners;
+	liveFrozenT = 0.0f;
+	numLiveFrozenShapes = numLiveFrozenCorners = 0;
+	results.publishResult(0, 0);
+}
 
-	// Generate splines
-	std::vector<Range> cornersAndSegments;
-	findCornersAndSegments(lineCopy, &cornersAndSegments);
-	generateBiarcsAndFinalShapes(lineCopy, &cornersAndSegments, &debugCorners, &displayShapes);
+ArcSpline::ResultPool::ResultPool(const ResultPool& other) : buildingIdx(0), published(nullptr)
+{
+	ref<const SplineResult> otherResult = other.getPublished();
+	if (!otherResult) { return; }
+	entries.push_back(Entry{ new SplineResult(*otherResult), 0, 0 });
+	published.store(entries.back().result, std::memory_order_release);
 }
 
-void ArcSpline::findCornersAndSegments(FreeformLine& line, std::vector<Range>* result)
+ref<const SplineResult> ArcSpline::ResultPool::getPublished() const
 {
-	// Find all corners
-	std::vector<Range> corners; corners.reserve(20);
+	for (;;)
 	{
-		Range fullLineBounds = { 0.0f, line.length() };
-		line.setBounds(fullLineBounds);
-		ArcSplineUtil::findCorners(line, processingInput->corners, &corners);
+		SplineResult* result = published.load(std::memory_order_acquire);
+		ref<const SplineResult> snapshot = result;
+
+		// Pairs with the fence in beginResult(): either this sees the result retired, or the writer sees the reference & doesn't recycle it
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		if (published.load(std::memory_order_acquire) == result) { return snapshot; }
 	}
+}
+
+SplineResult* ArcSpline::ResultPool::beginResult(size_t numKeptShapes, size_t numKeptCorners)
+{
+	// Recycle a retired result only the pool references
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	const SplineResult* current = published.load(std::memory_order_relaxed);
+	buildingIdx = 0;
+	while (buildingIdx < entries.size() && (entries[buildingIdx].result == current || 1 < entries[buildingIdx].result->getRefCount())) { buildingIdx++; }
+	if (buildingIdx == entries.size()) { entries.push_back(Entry{ new SplineResult(), 0, 0 }); }
+	// Readers dropped their references before, so they're done reading
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	// Keep the frozen elements it shares with the published result & copy the ones frozen since
+	Entry& entry = entries[buildingIdx];
+	SplineResult* result = entry.result;
+	const size_t numSameShapes = std::min(entry.numFrozenShapes, numKeptShapes);
+	const size_t numSameCorners = std::min(entry.numFrozenCorners, numKeptCorners);
+	result->displayShapes.resize(numSameShapes);
+	result->debugCorners.resize(numSameCorners);
+	if (numSameShapes < numKeptShapes) { result->displayShapes.insert(result->displayShapes.end(), current->displayShapes.begin() + numSameShapes, current->displayShapes.begin() + numKeptShapes); }
+	if (numSameCorners < numKeptCorners) { result->debugCorners.insert(result->debugCorners.end(), current->debugCorners.begin() + numSameCorners, current->debugCorners.begin() + numKeptCorners); }
+	entry.numFrozenShapes = numSameShapes;
+	entry.numFrozenCorners = numSameCorners;
+	return result;
+}
+
+void ArcSpline::ResultPool::publishResult(size_t numFrozenShapes, size_t numFrozenCorners)
+{
+	Entry& entry = entries[buildingIdx];
+	entry.numFrozenShapes = numFrozenShapes;
+	entry.numFrozenCorners = numFrozenCorners;
+	published.store(entry.result, std::memory_order_release);
+}
+
+void ArcSpline::ResultPool::forgetFrozen()
+{
+	for (Entry& entry : entries) { entry.numFrozenShapes = entry.numFrozenCorners = 0; }
+}
+
+void ArcSpline::findCornersAndSegments(const FreeformLine& line, ArenaVector<Range>* result)
+{
+	// Find all corners, unless the line & corner settings are the same as last time
+	const LineKey lineKey = { line.getRevision(), line.halfSmoothingSpread, line.tangentFieldResolution };
+	if (!cornersCache.isValid || cornersCache.line != lineKey || cornersCache.input != processingInput->corners)
+	{
+		ME_STAGE_TIMER(STAGE_FIND_CORNERS);
+		cornersCache.corners.clear(); cornersCache.corners.reserve(20);
+		FreeformLineSection fullLine(line, Range(0.0f, line.length()), !processingInput->corners.coarseToFine, result->get_allocator().arena);
+		ArcSplineUtil::findCorners(fullLine, processingInput->corners, &cornersCache.corners);
+
+		cornersCache.isValid = true;
+		cornersCache.line = lineKey;
+		cornersCache.input = processingInput->corners;
+		segmentsCache.isValid = false;
+	}
+
+	// Find segments, unless corners & segment settings are the same as last time
+	if (!segmentsCache.isValid || segmentsCache.input != processingInput->segments)
+	{
+		ArenaVector<Range> corners(cornersCache.corners.begin(), cornersCache.corners.end(), result->get_allocator());
+		ArenaVector<Range> cornersAndSegments(result->get_allocator());
+		findSegmentsBetweenCorners(line, Range(0.0f, line.length()), &corners, &cornersAndSegments);
+		segmentsCache.cornersAndSegments.assign(cornersAndSegments.begin(), cornersAndSegments.end());
+
+		segmentsCache.isValid = true;
+		segmentsCache.input = processingInput->segments;
+	}
+
+	result->insert(result->end(), segmentsCache.cornersAndSegments.begin(), segmentsCache.cornersAndSegments.end());
+}
+
+void ArcSpline::findSegmentsBetweenCorners(const FreeformLine& line, const Range& bounds, ArenaVector<Range>* mutableCorners, ArenaVector<Range>* result)
+{
+	ME_STAGE_TIMER(STAGE_SEGMENT_TESTS);
 
 	// For each two consecutive corners check if they can be connected by a segment.
-	std::vector<Range> segments; segments.reserve(20);
+	ArenaVector<Range> segments(result->get_allocator()); segments.reserve(20);
 	{
-		corners.push_back(Range{ line.length(), line.length() }); // add a terminal
-		float prevCorner = 0.0f;
-		for (const Range& c : corners)
+		mutableCorners->push_back(Range{ bounds.end, bounds.end }); // add a terminal
+		float prevCorner = bounds.start;
+		for (const Range& c : *mutableCorners)
 		{
 			const Range segment = { prevCorner, c.start };
 			float meanError2;
@@ -55,68 +240,107 @@ void ArcSpline::findCornersAndSegments(FreeformLine& line, std::vector<Range>* r
 			}
 			prevCorner = c.end;
 		}
-		corners.pop_back(); // pop the terminal
+		mutableCorners->pop_back(); // pop the terminal
 	}
 
 	// Sort segments and corners together
 	//
-	result->insert(result->end(), corners.begin(), corners.end());
+	result->insert(result->end(), mutableCorners->begin(), mutableCorners->end());
 	result->insert(result->end(), segments.begin(), segments.end());
 	std::sort(result->begin(), result->end(), Range::isLess);
 }
 
-void ArcSpline::generateBiarcsAndFinalShapes(FreeformLine& line, std::vector<Range>* mutableCornersAndSegments, std::vector<Vector2>* outCorners, std::vector<ref<SplineElement>>* outDisplayShapes)
+bool ArcSpline::generateBiarcsAndFinalShapes(const FreeformLine& line, const Range& bounds, ArenaVector<Range>* mutableCornersAndSegments, std::vector<Vector2>* outCorners, std::vector<SplineElement>* outDisplayShapes,
+	const CancellationToken* cancellation /*= nullptr*/)
 {
 	// Add a terminal
-	mutableCornersAndSegments->push_back(Range{ line.length(), line.length() + 1.0f });
+	mutableCornersAndSegments->push_back(Range{ bounds.end, bounds.end + 1.0f });
+
+	// Collect line sections between markers (corners) which are not connected by a segment
+	ArenaVector<Range> sections(mutableCornersAndSegments->get_allocator()); sections.reserve(mutableCornersAndSegments->size());
+	{
+		Range prevMarker = { -1.0f, bounds.start };
+		for (const Range& s : *mutableCornersAndSegments)
+		{
+			Range boundsBetweenMarkers = { prevMarker.end, s.start };
+			ME_ASSERT(boundsBetweenMarkers.length() >= 0.0f);
+			if (boundsBetweenMarkers.length() > ME_MAX_SPLINE_GAP) { sections.push_back(boundsBetweenMarkers); }
+			prevMarker = s;
+		}
+	}
+
+	// Take a result buffer for each section
+	BiarcBuffers& biarcBuffers = t_biarcBuffers;
+	const size_t firstBuffer = biarcBuffers.numInUse;
+	while (biarcBuffers.buffers.size() < firstBuffer + sections.size()) { biarcBuffers.buffers.emplace_back(); }
+	biarcBuffers.numInUse += sections.size();
+	ArenaVector<std::vector<Biarc>*> sectionBiarcs(sections.get_allocator());
+	for (size_t i = 0; i < sections.size(); i++) { sectionBiarcs.push_back(&biarcBuffers.buffers[firstBuffer + i]); }
+
+	// Convert sections into biarc-splines concurrently. Each task has its own clipping bounds, and writes to its own result.
+	// The biarc fitting here doesn't read the section's tangent field, so it isn't built.
+	const ArcSplineUtil::BiarcsInput& biarcsInput = processingInput->biarcs;
+	ME_ON_INSTRUMENTATION(ArenaVector<SplineStats> sectionStats(sections.size(), SplineStats(), sections.get_allocator()));
+	auto convertSection = [&](int idx)
+	{
+		if (cancellation && cancellation->isCancelled()) { return; }
+		ME_SCOPED_STATS(&sectionStats[idx]);
+		ME_STAGE_TIMER(STAGE_BIARC_FITTING);
+		MonotonicArena::Scope scratch;
+		FreeformLineSection section(line, sections[idx], false, scratch.getArena());
+		sectionBiarcs[idx]->clear();
+		sectionBiarcs[idx]->reserve(20);
+		ArcSplineUtil::convertLineToBiarcs(section, biarcsInput, sectionBiarcs[idx]);
+	};
+	ThreadPool::getShared().parallelFor((int)sections.size(), std::ref(convertSection)); // wrapping a reference doesn't allocate
+	ME_ON_INSTRUMENTATION(for (const SplineStats& s : sectionStats) { stats.add(s); });
+	if (cancellation && cancellation->isCancelled())
+	{
+		// Sections may have been skipped
+		mutableCornersAndSegments->pop_back();
+		biarcBuffers.numInUse = firstBuffer;
+		return false;
+	}
+	ME_STAGE_TIMER(STAGE_SHAPE_CREATION);
+	ME_ON_INSTRUMENTATION(const size_t numShapesBefore = outDisplayShapes->size());
 
 	// Generate biarcs & put everything into a display-shape array
 	//
 	outCorners->reserve(20);
 	outDisplayShapes->reserve(200);
 
-	// Iterate through corners & segments combined into one list.
-	//  - create display shapes for segments, 
-	//  - convert non-segment sections into biarc splines & generate display shapes 
-	std::vector<Biarc> biarcs; biarcs.reserve(20);
-	Range prevMarker = { -1.0f, 0.0f };
+	// Iterate through corners & segments combined into one list, in order.
+	//  - create display shapes for the biarc splines of non-segment sections,
+	//  - create display shapes for segments
+	FreeformLine::Cursor markerCursor(line);
+	Range prevMarker = { -1.0f, bounds.start };
+	size_t sectionIdx = 0;
 	for (const Range& s : *mutableCornersAndSegments)
 	{
 		Range boundsBetweenMarkers = { prevMarker.end, s.start };
-		ME_ASSERT(boundsBetweenMarkers.length() >= 0.0f);
 
-		// Create biarc-splines between markers (corners) which are not connected by a segment
+		// Create display shapes for each sub-shapes of each Biarc
+		// 
 		if (boundsBetweenMarkers.length() > ME_MAX_SPLINE_GAP)
 		{
-			// Generate biarcs
-			//
-			processingInput->biarcs.tBounds = boundsBetweenMarkers;
-			line.setBounds(boundsBetweenMarkers);
-			biarcs.clear();
-			ArcSplineUtil::convertLineToBiarcs(line, processingInput->biarcs, &biarcs);
-
-			// Create display shapes for each sub-shapes of each Biarc
-			// 
-			ref<SplineElement> shape;
-			for (const auto& b : biarcs)
+			ME_ASSERT(sectionIdx < sections.size() && sections[sectionIdx].start == boundsBetweenMarkers.start);
+			for (const auto& b : *sectionBiarcs[sectionIdx++])
 			{
 				if (ME_MAX_SPLINE_GAP <= b.point0.distTo(b.midPoint()))
 				{
 					switch (b.shape0.type)
 					{
-					case CircleOrLine::TYPE_CIRCLE: shape = new SplineArc(b.shape0.circle, b.point0, b.tangent0, b.midPoint(), 0); break;
-					case CircleOrLine::TYPE_LINE: shape = new SplineSegment(b.point0, b.midPoint(), 0); break;
+					case CircleOrLine::TYPE_CIRCLE: outDisplayShapes->push_back(SplineElement::fromArc(b.shape0.circle, b.point0, b.tangent0, b.midPoint(), 0)); break;
+					case CircleOrLine::TYPE_LINE: outDisplayShapes->push_back(SplineElement::fromSegment(b.point0, b.midPoint(), 0)); break;
 					}
-					outDisplayShapes->push_back(shape);
 				}
 				if (ME_MAX_SPLINE_GAP <= b.point1.distTo(b.midPoint()))
 				{
 					switch (b.shape1.type)
 					{
-					case CircleOrLine::TYPE_CIRCLE: shape = new SplineArc(b.shape1.circle, b.midPoint(), b.midTangent(), b.point1, 1); break;
-					case CircleOrLine::TYPE_LINE: shape = new SplineSegment(b.midPoint(), b.point1, 1); break;
+					case CircleOrLine::TYPE_CIRCLE: outDisplayShapes->push_back(SplineElement::fromArc(b.shape1.circle, b.midPoint(), b.midTangent(), b.point1, 1)); break;
+					case CircleOrLine::TYPE_LINE: outDisplayShapes->push_back(SplineElement::fromSegment(b.midPoint(), b.point1, 1)); break;
 					}
-					outDisplayShapes->push_back(shape);
 				}
 			}
 		}
@@ -124,68 +348,71 @@ void ArcSpline::generateBiarcsAndFinalShapes(FreeformLine& line, std::vector<Ran
 		// Create display object for segments
 		if (s.length() > ME_MAX_SPLINE_GAP)
 		{
-			ref<SplineElement> shape = new SplineSegment(line.getPointAt(s.start), line.getPointAt(s.end));
-			outDisplayShapes->push_back(shape);
+			Vector2 p0 = markerCursor.getPointAt(s.start);
+			Vector2 p1 = markerCursor.getPointAt(s.end);
+			outDisplayShapes->push_back(SplineElement::fromSegment(p0, p1));
 		}
 		// Create display info for corners
 		else if (s.length() == 0.0f)
 		{
-			outCorners->push_back(line.getPointAt(s.start));
+			outCorners->push_back(markerCursor.getPointAt(s.start));
 		}
 		prevMarker = s;
 	}
 
-	// Remove terminal
+	// Remove terminal & release the result buffers
 	mutableCornersAndSegments->pop_back();
+	biarcBuffers.numInUse = firstBuffer;
+	ME_COUNT_N(COUNTER_SHAPES_EMITTED, outDisplayShapes->size() - numShapesBefore);
+	return true;
 }
 
-SplineArc::SplineArc(const Circle& circle, const Vector2& p0, const Vector2& tangentAtP0, const Vector2& p1, int idx /*= -1*/) : SplineElement(SplineElement::TYPE_ARC), circle(circle), idxInBiarc(idx)
+SplineElement SplineElement::fromArc(const Circle& circle, const Vector2& p0, const Vector2& tangentAtP0, const Vector2& p1, int idx /*= -1*/)
 {
+	SplineElement result;
+	result.type = TYPE_ARC;
+	result.idxInBiarc = (int8_t)idx;
+	result.circle = circle;
+
 	const Vector2 arm0 = p0 - circle.center();
 	const Vector2 arm1 = p1 - circle.center();
-	startAngle = std::atan2f(arm0.y, arm0.x) * ME_RAD_TO_DEG;
-	const float endAngle = std::atan2f(arm1.y, arm1.x) * ME_RAD_TO_DEG;
-	sweepAngle = endAngle - startAngle;
+	result.startAngle = std::atan2(arm0.y, arm0.x) * ME_RAD_TO_DEG;
+	const float endAngle = std::atan2(arm1.y, arm1.x) * ME_RAD_TO_DEG;
+	result.sweepAngle = endAngle - result.startAngle;
+	if (arm0.cross(tangentAtP0) * result.sweepAngle < 0.0f) { result.sweepAngle += result.sweepAngle < 0.0f ? 360.0f : -360.0f; }
 
-	const float cross = arm0.normalized().cross(arm1.normalized());
-	const float dot = arm0.normalized().dot(arm1.normalized());
-	if (arm0.cross(tangentAtP0) * sweepAngle < 0.0f) { sweepAngle += sweepAngle < 0.0f ? 360.0f : -360.0f; }
+	// Endpoints exactly on the circle
+	result.p0 = circle.center() + (Vector2::unitX * circle.radius).rotate(result.startAngle * ME_DEG_TO_RAD);
+	result.p1 = circle.center() + (Vector2::unitX * circle.radius).rotate((result.startAngle + result.sweepAngle) * ME_DEG_TO_RAD);
+	return result;
 }
 
-float SplineArc::distTo(const Vector2& point) const
+SplineElement SplineElement::fromSegment(const Vector2& p0, const Vector2& p1, int idx /*= -1*/)
 {
-	// check if point is within the arc
-	float endAngle = startAngle + sweepAngle;
-	float start = std::fmin(startAngle, endAngle);
-	float end = std::fmax(startAngle, endAngle);
-
-	Vector2 arm = point - circle.center();
-	float angle = std::atan2(arm.y, arm.x) * ME_RAD_TO_DEG;
-	if (angle < start) { angle += 360.0f; }
-	if (end < angle) { angle -= 360.0f; }
-
-	bool isWithingAngles = start <= angle && angle <= end;
-
-	if (isWithingAngles)
-	{
-		return std::fabs(arm.norm() - circle.radius);
-	}
-	else
-	{
-		return SplineArc::distToEndPoint(point);
-	}
+	SplineElement result;
+	result.type = TYPE_SEGMENT;
+	result.idxInBiarc = (int8_t)idx;
+	result.p0 = p0;
+	result.p1 = p1;
+	result.circle = Circle{ 0.0f, 0.0f, 0.0f };
+	result.startAngle = result.sweepAngle = 0.0f;
+	return result;
 }
 
-float SplineArc::distToEndPoint(const Vector2& point) const
+float SplineElement::distTo(const Vector2& point) const
 {
-	float endAngle = startAngle + sweepAngle;
-	Vector2 p0 = circle.center() + (Vector2::unitX * circle.radius).rotate(startAngle * ME_DEG_TO_RAD);
-	Vector2 p1 = circle.center() + (Vector2::unitX * circle.radius).rotate(endAngle * ME_DEG_TO_RAD);
-	return std::fmin(point.distTo(p0), point.distTo(p1));
-}
+	if (TYPE_ARC == type)
+	{
+		// The point is within the arc's angles, if its arm is on the inner side of both end arms. Arcs over 180 degrees only need one of them.
+		const Vector2 arm = point - circle.center();
+		const float side = sweepAngle < 0.0f ? -1.0f : 1.0f;
+		const bool isInside0 = 0.0f <= side * (p0 - circle.center()).cross(arm);
+		const bool isInside1 = 0.0f <= side * arm.cross(p1 - circle.center());
+		const bool isWithinAngles = std::fabs(sweepAngle) <= 180.0f ? isInside0 && isInside1 : isInside0 || isInside1;
+		return isWithinAngles ? std::fabs(arm.norm() - circle.radius) : distToEndPoint(point);
+	}
 
-float SplineSegment::distTo(const Vector2& point) const
-{
+	// Closest point of the segment
 	Vector2 closestPoint;
 	do
 	{
@@ -204,8 +431,3 @@ float SplineSegment::distTo(const Vector2& point) const
 
 	return closestPoint.distTo(point);
 }
-
-float SplineSegment::distToEndPoint(const Vector2& point) const
-{
-	return std::fmin(point.distTo(p0), point.distTo(p1));
-}
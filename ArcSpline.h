@@ -1,9 +1,13 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <vector>
 
 #include "ArcSplineUtil.h" // for input struct
 #include "Geometry.h"
+#include "Instrumentation.h"
+#include "MonotonicArena.h"
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 Please, note that ArcSpline generation has been tweaked to work well
@@ -14,106 +18,223 @@ local curvatures of several units & more preferably tens of units.
 
 Consider always scaling FreeformLine input to it's visible on-screen size to get
 consistent drawing behavior & user experience.
+
+Corners & segments are cached together with the inputs they were computed for,
+so recreateSpline() after changing biarc settings only refits the biarcs.
+
+While a line is being drawn, updateLiveSpline() keeps the spline up to date
+incrementally. Corners & segments far enough before the line's end can't change
+as the line grows, so everything before the last such marker is frozen & only
+the remaining tail is recomputed. If no marker shows up for maxLiveTailLength,
+the tail is split artificially, so the update cost stays bounded. Those splits
+are the only difference from recreateSpline(), which should be run once the
+line is finished.
+
+Line sections between markers are converted to biarcs independently, so they
+run concurrently on the shared ThreadPool. Each task views the line through its
+own FreeformLineSection, and the results are merged in marker order, so the
+spline is the same regardless of the number of threads.
+
+Scratch lists of a pass come from the MonotonicArena of the running thread &
+result buffers are reused, so recomputing a spline over & over, e.g. while
+tweaking it, doesn't touch the heap once the buffers have grown.
+
+recreateSpline() can be given a CancellationToken, which is checked after
+corners & segments are found, and before each section is converted to biarcs.
+Once it's cancelled, the remaining work is skipped & the result is dropped;
+SplineRecomputer uses that to drop obsolete recomputes.
+
+Results are published as immutable SplineResult snapshots, RCU-style: a pass
+builds a new result next to the published one & swaps a single pointer when
+it's complete. getResult() never blocks & never sees a half-built result, so
+drawing & hit-testing can run while the spline is recomputed on another
+thread. Retired results are reclaimed once no reader holds them, by recycling
+them for later passes; a live spline's recycled result only catches up on the
+elements frozen since, so updates stay cheap. Only one thread at a time may
+recompute a spline.
+
+Results hold their SplineElements by value in one array, 40 bytes each, instead
+of a heap object per element. Elements are hit-tested one at a time, without a
+batched distTo(): SplineIndex only hands a query the few elements listed near
+the point.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 
 class FreeformLine;
-class SplineElement;
 
-// Holds reference to the source/input FreeformLine & the resulting list of
-// SplineElements (Arcs & Segments). Additionally it keeps a list of debugCorners
-// to mark points of tangent discontinuity, and a reference to ProcessingInput
-// used to generate the spline.
-class ArcSpline : public RefCounted
+// Element of ArcSpline: an arc or a segment, stored by value in a flat array.
+// Endpoints are precomputed, so hit-testing with distTo() & distToEndPoint() needs no trigonometry.
+struct SplineElement
 {
-public:
-	ArcSpline(const FreeformLine* line, ArcSplineUtil::ProcessingInput* processingInput = new ArcSplineUtil::ProcessingInput());
-
-	// Recalculate the spline with updated processingInput
-	void recreateSpline(ArcSplineUtil::ProcessingInput* processingInput = nullptr);
+	// Create an arc of a circle from p0, heading along tangentAtP0, to p1
+	static SplineElement fromArc(const Circle& circle, const Vector2& p0, const Vector2& tangentAtP0, const Vector2& p1, int idx = -1);
 
-	// Input FreeformLine
-	const ref<const FreeformLine> sourceLine;
+	// Create a segment between two points
+	static SplineElement fromSegment(const Vector2& p0, const Vector2& p1, int idx = -1);
 
-	// Algorithm parameters used for computing the spline
-	ref<ArcSplineUtil::ProcessingInput> processingInput;
+	// Dist from the shape to the point
+	float distTo(const Vector2& point) const;
 
-	// Elements forming the spline
-	std::vector<ref<SplineElement>> displayShapes; 
+	// Minimum dist from either of the endpoints of the shape to the specified point
+	float distToEndPoint(const Vector2& point) const { return std::fmin(point.distTo(p0), point.distTo(p1)); }
 
-	// List of corners, where tangent continuity is broken. This is purely for displaying.
-	std::vector<Vector2> debugCorners;
+	// Types of SplineElement
+	enum Type : int8_t { TYPE_INVALID = ME_MUST_BE_ZERO, TYPE_ARC, TYPE_SEGMENT } type;
 
-protected:
+	// Index indicating whether this is the starting or ending shape in the original biarc, or -1 for independently identified segments. Only used for drawing.
+	int8_t idxInBiarc;
 
-	// Identify corners and segments
-	void findCornersAndSegments(FreeformLine& line, std::vector<Range>* result);
+	// Endpoints; of arcs too
+	Vector2 p0, p1;
 
-	// Convert non-segment line sections into biarc-splines & convert all resulting geometric shapes into SplineElements.
-	void generateBiarcsAndFinalShapes(FreeformLine& line, std::vector<Range>* mutableCornersAndSegments, std::vector<Vector2>* outCorners, std::vector<ref<SplineElement>>* outDisplayShapes);
+	// Arcs only: the circle that defines the arc, and its start & sweep angles in degrees
+	Circle circle;
+	float startAngle, sweepAngle;
 };
 
 
-// Base class for elements of ArcSpline.
-// Implement distTo() & distToEndPoint() methods to allow click-selecting.
-class SplineElement : public RefCounted
+// Lets a spline computation stop early, once its result isn't needed anymore. Checked from several threads.
+class CancellationToken
 {
 public:
-	// Types of SplineElement
-	enum Type { TYPE_INVALID = ME_MUST_BE_ZERO, TYPE_ARC, TYPE_SEGMENT } const type;
+	virtual ~CancellationToken() { }
 
-	// Dist from the shape to the point
-	virtual float distTo(const Vector2& point) const { return FLT_MAX; }
+	// Should the computation stop
+	virtual bool isCancelled() const = 0;
+};
 
-	// Minimum dist from either of the endpoints of the shape to the specified point
-	virtual float distToEndPoint(const Vector2& point) const { return FLT_MAX; }
 
-protected:
-	SplineElement(Type type) : type(type) { } // not a final class
+// Result of an ArcSpline pass. Never changes while it's published or held by a reader, see ArcSpline::getResult().
+struct SplineResult : ThreadSafeRefCounted
+{
+	// Elements forming the spline
+	std::vector<SplineElement> displayShapes;
 
-private:
-	SplineElement() : type(TYPE_INVALID) { } // disallow
+	// List of corners, where tangent continuity is broken. This is purely for displaying.
+	std::vector<Vector2> debugCorners;
 };
 
 
-// Arc shape forming the ArcSpline
-class SplineArc : public SplineElement
+// Holds reference to the source/input FreeformLine & the resulting list of
+// SplineElements (Arcs & Segments). Additionally it keeps a list of debugCorners
+// to mark points of tangent discontinuity, and a reference to ProcessingInput
+// used to generate the spline. Both lists are published in SplineResults.
+class ArcSpline : public ThreadSafeRefCounted
 {
 public:
-	SplineArc(const Circle& circle, const Vector2& p0, const Vector2& tangentAtP0, const Vector2& p1, int idx = -1);
+	ArcSpline(const FreeformLine* line, ArcSplineUtil::ProcessingInput* processingInput = new ArcSplineUtil::ProcessingInput());
 
-	// Dist from the shape to the point
-	virtual float distTo(const Vector2& point) const;
+	// Publish a result computed earlier for the same line & processingInput, e.g. stored in a SplineCache, without computing anything
+	ArcSpline(const FreeformLine* line, ArcSplineUtil::ProcessingInput* processingInput, const SplineResult& result);
 
-	// Minimum dist from either of the endpoints of the shape to the specified point
-	virtual float distToEndPoint(const Vector2& point) const;
+	// Recalculate the spline with updated processingInput. Returns false if cancelled; the published result stays unchanged then.
+	bool recreateSpline(ArcSplineUtil::ProcessingInput* processingInput = nullptr, const CancellationToken* cancellation = nullptr);
 
-	// The circle that defines the arc
-	Circle circle;
+	// Update the spline after points were added to sourceLine; only the unfrozen tail is recomputed
+	void updateLiveSpline();
 
-	// Start and end angles of the arc
-	float startAngle, sweepAngle;
+	// Latest complete result; callable from any thread, also while the spline is recomputed. Never blocks & the result doesn't change while it's held.
+	ref<const SplineResult> getResult() const { return results.getPublished(); }
 
-	// Index indicating whether this is the starting or ending arc in the original biarc. Only used for drawing.
-	int idxInBiarc;
-};
+	// Publish a copy of a result computed elsewhere, e.g. on a copy of this spline
+	void setResult(const SplineResult& result);
 
+	// Longest tail updateLiveSpline() recomputes, before freezing it at an artificial split
+	float maxLiveTailLength = 1000.0f;
 
-// Segment shape forming the ArcSpline
-class SplineSegment : public SplineElement
-{
-public:
-	SplineSegment(const Vector2& p0, const Vector2& p1, int idx = -1) : SplineElement(TYPE_SEGMENT), p0(p0), p1(p1), idxInBiarc(idx) { }
+	// Input FreeformLine
+	const ref<const FreeformLine> sourceLine;
 
-	// Dist from the shape to the point
-	virtual float distTo(const Vector2& point) const;
+	// Algorithm parameters used for computing the spline
+	ref<ArcSplineUtil::ProcessingInput> processingInput;
 
-	// Minimum dist from either of the endpoints of the shape to the specified point
-	virtual float distToEndPoint(const Vector2& point) const;
+#if ME_ENABLE_INSTRUMENTATION
+	// Timings & counters of the last recreateSpline() or updateLiveSpline()
+	SplineStats stats;
+#endif
 
-	// Segment endpoints
-	Vector2 p0, p1;
+	// Increment whenever a change of the algorithm changes results for the same line & processingInput; results stored in SplineCaches are recomputed then
+	static const uint32_t algorithmVersion = 1;
+
+protected:
 
-	// Index indicating if this segment was identified independently, or is a part of a biarc. Only used for drawing.
-	int idxInBiarc;
-};
\ No newline at end of file
+	// Identify corners and segments
+	void findCornersAndSegments(const FreeformLine& line, ArenaVector<Range>* result);
+
+	// Identify segments between consecutive corners within bounds, and sort them together with the corners
+	void findSegmentsBetweenCorners(const FreeformLine& line, const Range& bounds, ArenaVector<Range>* mutableCorners, ArenaVector<Range>* result);
+
+	// Convert non-segment line sections within bounds into biarc-splines on the shared ThreadPool & convert all resulting geometric shapes into SplineElements, in order.
+	// Returns false without adding anything if cancelled.
+	bool generateBiarcsAndFinalShapes(const FreeformLine& line, const Range& bounds, ArenaVector<Range>* mutableCornersAndSegments, std::vector<Vector2>* outCorners, std::vector<SplineElement>* outDisplayShapes,
+		const CancellationToken* cancellation = nullptr);
+
+	// Published result & the retired ones, recycled once no reader holds them. Copying the pool only copies the published result.
+	class ResultPool
+	{
+	public:
+		ResultPool() : buildingIdx(0), published(nullptr) { }
+		ResultPool(const ResultPool& other);
+
+		// Reference the published result; lock-free, retries if a new one is published meanwhile
+		ref<const SplineResult> getPublished() const;
+
+		// Take a result no reader holds, starting with the first numKeptShapes & numKeptCorners elements of the published one
+		SplineResult* beginResult(size_t numKeptShapes, size_t numKeptCorners);
+
+		// Publish the result taken by beginResult(); its first numFrozenShapes & numFrozenCorners elements stay the same in later results, until forgetFrozen()
+		void publishResult(size_t numFrozenShapes, size_t numFrozenCorners);
+
+		// Later results may differ from earlier ones anywhere
+		void forgetFrozen();
+
+	private:
+		ResultPool& operator = (const ResultPool&) = delete;
+
+		// A result & the number of its leading elements that are frozen
+		struct Entry
+		{
+			ref<SplineResult> result;
+			size_t numFrozenShapes, numFrozenCorners;
+		};
+
+		// All results ever published. getPublished() may be about to reference a retired one, so they're only freed with the pool.
+		std::vector<Entry> entries;
+
+		// Entry taken by beginResult()
+		size_t buildingIdx;
+
+		// Result readers see, one of entries
+		std::atomic<SplineResult*> published;
+	} results;
+
+	// Frozen part of a live spline: line section before liveFrozenT, and the number of displayShapes & debugCorners generated for it
+	float liveFrozenT;
+	size_t numLiveFrozenShapes, numLiveFrozenCorners;
+
+	// Identifies the state of the source line that cached corners were computed for
+	struct LineKey
+	{
+		unsigned int revision;
+		float halfSmoothingSpread, tangentFieldResolution;
+		bool operator == (const LineKey& b) const { return revision == b.revision && halfSmoothingSpread == b.halfSmoothingSpread && tangentFieldResolution == b.tangentFieldResolution; }
+		bool operator != (const LineKey& b) const { return !operator == (b); }
+	};
+
+	// Corners found by findCornersAndSegments(), and the inputs they depend on
+	struct CornersCache
+	{
+		bool isValid = false;
+		LineKey line;
+		ArcSplineUtil::CornersInput input;
+		std::vector<Range> corners;
+	} cornersCache;
+
+	// Corners & segments found by findCornersAndSegments(), valid while cornersCache is unchanged & for the same input
+	struct SegmentsCache
+	{
+		bool isValid = false;
+		ArcSplineUtil::SegmentsInput input;
+		std::vector<Range> cornersAndSegments;
+	} segmentsCache;
+};
@@ -1,12 +1,122 @@
 #include "FreeformTool.h"
 #include "ArcSplineUtil.h"
 
+#include <algorithm>
+#include <cmath>
+
+#include "ErrorKernels.h"
 #include "FreeformLine.h"
+#include "FreeformLineSection.h"
 #include "Geometry.h"
+#include "MonotonicArena.h"
+#include "StrokePyramid.h"
+
+// Coarse tangents only approximate the smoothed ones, so candidates need an inner angle of just this fraction of the minimum
+#define ME_COARSE_CORNER_TOLERANCE 0.5f
+
+// Most levels of the stroke pyramid used for finding corner candidates
+#define ME_MAX_CORNER_PYRAMID_LEVELS 2
+
+// Find windows of the corner scan where the corner test may pass; see findCorners().
+//
+// Levels of a stroke pyramid are processed from the coarsest to the finest. Each samples tangents on its grid around
+// the windows kept by the coarser level, and keeps the cells around grid points where the inner angle of the corner
+// test, between tangents interpolated from the grid ones, comes close to the minimum. Outer angles aren't tested, as
+// coarse tangents blur the turn of a corner into them. Windows are then padded & joined, so the scan enters & leaves
+// each of them with negative tests, and corners of different windows never merge.
+//
+// This is a heuristic: on very noisy strokes, the full scan may find a few corners outside the windows.
+static void findCornerCandidates(const FreeformLineSection& section, const ArcSplineUtil::CornersInput& input, const float (&d)[4], const Range& scanRange, ArenaVector<Range>* result)
+{
+	const FreeformLine& line = section.getLine();
+
+	// Coarsest spacing is the largest power of two within the distance of the compared tangents; finer levels go down to two scan steps
+	const float innerDist = input.innerInterMeasurementFactor * line.halfSmoothingSpread;
+	float baseSpacing = 1.0f;
+	while (2.0f * baseSpacing <= innerDist) { baseSpacing *= 2.0f; }
+	while (innerDist < baseSpacing && 2.0f * input.tStep < baseSpacing) { baseSpacing *= 0.5f; }
+	int numLevels = 1;
+	for (; numLevels < ME_MAX_CORNER_PYRAMID_LEVELS && 2.0f * input.tStep <= 0.5f * baseSpacing; numLevels++) { baseSpacing *= 0.5f; }
+
+	StrokePyramid pyramid(section.getArena());
+	pyramid.build(line, section.getBounds(), baseSpacing, numLevels);
+	const float gridStart = pyramid.getRange().start;
+	const float minInnerAngle = ME_COARSE_CORNER_TOLERANCE * input.innerMinAngleInDeg;
+
+	ArenaVector<Range> windows(section.getArena()), levelWindows(section.getArena());
+	ArenaVector<Vector2> tangents(section.getArena());
+	windows.push_back(scanRange);
+	for (int level = pyramid.numLevels() - 1; 0 <= level; level--)
+	{
+		const float spacing = pyramid.getSpacing(level);
+		const float invSpacing = 1.0f / spacing;
+		auto getFirstPoint = [&](const Range& w) { return int(std::floor((w.start - gridStart) * invSpacing)); };
+		auto getLastPoint = [&](const Range& w) { return int(std::ceil((w.end - gridStart) * invSpacing)); };
+		auto getFirstTangent = [&](const Range& w) { return int(std::floor(float(getFirstPoint(w)) + d[1] * invSpacing)); };
+		auto getEndTangent = [&](const Range& w) { return int(std::floor(float(getLastPoint(w)) + d[2] * invSpacing)) + 2; };
+
+		levelWindows.clear();
+		for (size_t groupStart = 0, groupEnd = 0; groupStart < windows.size(); groupStart = groupEnd)
+		{
+			// Windows close enough to share grid tangents are processed together
+			const int firstIdx = getFirstTangent(windows[groupStart]);
+			int endIdx = firstIdx;
+			for (groupEnd = groupStart; groupEnd < windows.size() && (groupEnd == groupStart || getFirstTangent(windows[groupEnd]) <= endIdx); groupEnd++)
+			{
+				endIdx = getEndTangent(windows[groupEnd]);
+			}
+
+			// Grid tangents around the windows
+			tangents.clear();
+			for (int idx = firstIdx; idx < endIdx; idx++)
+			{
+				float ta, tb;
+				section.getTangentSamplingPoints(gridStart + float(idx) * spacing, &ta, &tb);
+				tangents.push_back((pyramid.getPointAt(level, tb) - pyramid.getPointAt(level, ta)).normalized());
+			}
+
+			for (size_t windowIdx = groupStart; windowIdx < groupEnd; windowIdx++)
+			{
+				const Range& w = windows[windowIdx];
+				for (int point = getFirstPoint(w); point <= getLastPoint(w); point++)
+				{
+					// Inner angle at the grid point
+					Vector2 innerTangents[2];
+					for (int i = 0; i < 2; i++)
+					{
+						const float x = float(point) + d[i + 1] * invSpacing;
+						const int idx = int(std::floor(x));
+						const float frac = x - float(idx);
+						innerTangents[i] = Vector2::interpolate(tangents[idx - firstIdx], tangents[idx + 1 - firstIdx], frac).normalized();
+					}
+					if (std::fabs(innerTangents[0].angleTo(innerTangents[1])) * ME_RAD_TO_DEG <= minInnerAngle) { continue; }
+
+					// Keep the cells around the point within the window
+					const float start = std::fmax(gridStart + float(point - 1) * spacing, w.start);
+					const float end = std::fmin(gridStart + float(point + 1) * spacing, w.end);
+					if (end < start) { continue; }
+					if (levelWindows.size() && start <= levelWindows.back().end) { levelWindows.back().end = std::fmax(levelWindows.back().end, end); }
+					else { levelWindows.push_back(Range(start, end)); }
+				}
+			}
+		}
+		windows.swap(levelWindows);
+	}
+
+	// Pad windows by a couple of negative steps, and join those with corners close enough to merge
+	const float padding = 2.0f * input.tStep;
+	const float maxGap = float(input.maxDistBetweenCornersToMerge) + 2.0f * input.tStep;
+	for (const Range& w : windows)
+	{
+		if (result->size() && w.start - padding <= result->back().end + maxGap) { result->back().end = w.end + padding; }
+		else { result->push_back(Range(w.start - padding, w.end + padding)); }
+	}
+}
 
-void ArcSplineUtil::findCorners(const FreeformLine& line, const CornersInput& input, std::vector<Range>* result)
+template <class TRanges> void ArcSplineUtil::findCorners(const FreeformLineSection& section, const CornersInput& input, TRanges* result)
 {
-	const Range& tBounds = line.getBounds();
+	const FreeformLine& line = section.getLine();
+	const Range& tBounds = section.getBounds();
 	Range cornerSection;
 
 	const float margin = std::ceil(input.outerInterMeasurementFactor + 0.5f * input.innerInterMeasurementFactor);
@@ -16,19 +126,87 @@ void ArcSplineUtil::findCorners(const FreeformLine& line, const CornersInput& in
 		(input.innerInterMeasurementFactor + input.outerInterMeasurementFactor) };
 	for (float& di : d) { di *= line.halfSmoothingSpread; }
 
-	for (float t = tBounds.start + margin; t <= tBounds.end - margin; t += input.tStep)
+	// Test all steps, or coarse-to-fine only those within windows where corners are possible; other steps are negatives
+	const float scanStart = tBounds.start + margin;
+	const float scanEnd = tBounds.end - margin;
+	ArenaVector<Range> windows(section.getArena());
+	if (scanStart <= scanEnd)
 	{
-		// hack:
-		Vector2 tangents[] = { line.getTangentAt(t + d[0]), line.getTangentAt(t + d[1]),
-			line.getTangentAt(t + d[2]), line.getTangentAt(t + d[3]) };
-		float angles[3] = { std::fabs(tangents[0].angleTo(tangents[1])) * ME_RAD_TO_DEG,
-			std::fabs(tangents[1].angleTo(tangents[2])) * ME_RAD_TO_DEG,
-			std::fabs(tangents[2].angleTo(tangents[3])) * ME_RAD_TO_DEG };
-		if (angles[0] < input.outerMaxAngleInDeg && // not needed?
-			angles[1] > input.innerMinAngleInDeg &&
-			angles[2] < input.outerMaxAngleInDeg && // not needed?
-			angles[0] / angles[1] < 1.0f / 3.0f &&
-			angles[2] / angles[1] < 1.0f / 3.0f)
+		if (input.coarseToFine) { findCornerCandidates(section, input, d, Range(scanStart, scanEnd), &windows); }
+		else { windows.push_back(Range(scanStart, scanEnd)); }
+	}
+
+
+	// Measurement points of consecutive steps overlap, so read tangents from a precomputed field. Without the section's field, sample one for each window.
+	const bool hasSectionField = section.getTangentField().isValid();
+	ME_ASSERT(hasSectionField || input.coarseToFine);
+	TangentField windowField(section.getArena());
+	const TangentField& tangentField = hasSectionField ? section.getTangentField() : windowField;
+
+	// For each corner section, find the best point to represent that corner
+	FreeformLine::Cursor pointCursor(line);
+	size_t numRefinedCorners = result->size();
+	auto refineCorners = [&]()
+	{
+		for (; numRefinedCorners < result->size(); numRefinedCorners++)
+		{
+			Range& c = (*result)[numRefinedCorners];
+			Vector2 tangent0 = tangentField.getTangentAt(c.start + d[1]);
+			Vector2 tangent1 = tangentField.getTangentAt(c.end + d[2]);
+			Vector2 searchDir = tangent0 - tangent1;
+			float tBest = 0.5f * (c.start + c.end);
+
+			if (searchDir.norm2() > ME_EPSILON2)
+			{
+				float furthestPosAlongDir = -FLT_MAX;
+				// Allow the corner to drift past the original limits (this is needed for series of segments of length close to line's halfSmoothingSpread
+				c.inflate(2.0f * input.innerInterMeasurementFactor * line.halfSmoothingSpread);
+				// find point that's furthest along the search direction
+				for (float t = c.start; t <= c.end; t++)
+				{
+					float posAlongDir = searchDir.dot(pointCursor.getPointAt(t));
+					if (furthestPosAlongDir < posAlongDir)
+					{
+						tBest = t;
+						furthestPosAlongDir = posAlongDir;
+					}
+				}
+			}
+
+			c = { tBest, tBest };
+		}
+	};
+
+	size_t windowIdx = 0, fieldWindowIdx = windows.size();
+	for (float t = scanStart; t <= scanEnd; t += input.tStep)
+	{
+		while (windowIdx < windows.size() && windows[windowIdx].end < t) { windowIdx++; }
+		bool isCornerStep = false;
+		if (windowIdx < windows.size() && windows[windowIdx].start <= t)
+		{
+			if (!hasSectionField && fieldWindowIdx != windowIdx)
+			{
+				// Corners of the previous window are complete; refine them before its tangents are replaced
+				refineCorners();
+				const Range& w = windows[windowIdx];
+				windowField.build(section, line.tangentFieldResolution, Range(w.start + d[0], w.end + d[3]));
+				fieldWindowIdx = windowIdx;
+			}
+
+			// hack:
+			Vector2 tangents[] = { tangentField.getTangentAt(t + d[0]), tangentField.getTangentAt(t + d[1]),
+				tangentField.getTangentAt(t + d[2]), tangentField.getTangentAt(t + d[3]) };
+			float angles[3] = { std::fabs(tangents[0].angleTo(tangents[1])) * ME_RAD_TO_DEG,
+				std::fabs(tangents[1].angleTo(tangents[2])) * ME_RAD_TO_DEG,
+				std::fabs(tangents[2].angleTo(tangents[3])) * ME_RAD_TO_DEG };
+			isCornerStep = angles[0] < input.outerMaxAngleInDeg && // not needed?
+				angles[1] > input.innerMinAngleInDeg &&
+				angles[2] < input.outerMaxAngleInDeg && // not needed?
+				angles[0] / angles[1] < 1.0f / 3.0f &&
+				angles[2] / angles[1] < 1.0f / 3.0f;
+		}
+
+		if (isCornerStep)
 		{
 			// store corner marking temporarily
 			cornerSection.include(t);
@@ -51,34 +229,7 @@ void ArcSplineUtil::findCorners(const FreeformLine& line, const CornersInput& in
 			cornerSection.invalidate();
 		}
 	}
-
-	// For each corner section, find the best point to represent that corner
-	for (Range& c : *result)
-	{
-		Vector2 tangent0 = line.getTangentAt(c.start + d[1]);
-		Vector2 tangent1 = line.getTangentAt(c.end + d[2]);
-		Vector2 searchDir = tangent0 - tangent1;
-		float tBest = 0.5f * (c.start + c.end);
-
-		if (searchDir.norm2() > ME_EPSILON2)
-		{
-			float furthestPosAlongDir = -FLT_MAX;
-			// Allow the corner to drift past the original limits (this is needed for series of segments of length close to line's halfSmoothingSpread
-			c.inflate(2.0f * input.innerInterMeasurementFactor * line.halfSmoothingSpread);
-			// find point that's furthest along the search direction
-			for (float t = c.start; t <= c.end; t++)
-			{
-				float posAlongDir = searchDir.dot(line.getPointAt(t));
-				if (furthestPosAlongDir < posAlongDir)
-				{
-					tBest = t;
-					furthestPosAlongDir = posAlongDir;
-				}
-			}
-		}
-
-		c = { tBest, tBest };
-	}
+	refineCorners();
 }
 
 bool ArcSplineUtil::isSegment(const FreeformLine& line, const Range segmentBounds, const SegmentsInput& input, float* meanError2)
@@ -88,12 +239,13 @@ bool ArcSplineUtil::isSegment(const FreeformLine& line, const Range segmentBound
 	Vector2 p1 = line.getPointAt(segmentBounds.end);
 	Line testFitLine = Line::between(p0, p1);
 	float dist = p0.distTo(p1);
-	*meanError2 = ArcSplineUtil::calcMeanSquaredError(line, segmentBounds.start, input.tStep, segmentBounds.end, testFitLine);
+	*meanError2 = line.areMomentsKept() ? line.getMoments(segmentBounds.start, segmentBounds.end).meanSquaredDist(testFitLine)
+		: ArcSplineUtil::calcMeanSquaredError(line, segmentBounds.start, input.tStep, segmentBounds.end, testFitLine);
 	float limitMultiplier = (dist / input.referenceSegmentLength);
 	return *meanError2 <= input.maxMeanErrorAtReferenceLength * input.maxMeanErrorAtReferenceLength * limitMultiplier;
 }
 
-void ArcSplineUtil::convertLineToBiarcs(const FreeformLine& line, const BiarcsInput& input, std::vector<Biarc>* result)
+void ArcSplineUtil::convertLineToBiarcs(const FreeformLineSection& section, const BiarcsInput& input, std::vector<Biarc>* result)
 {
 	/*
 
@@ -104,17 +256,26 @@ void ArcSplineUtil::convertLineToBiarcs(const FreeformLine& line, const BiarcsIn
 
 template <class TShape> float ArcSplineUtil::calcMeanSquaredError(const FreeformLine& line, float tStart, float tStep, float tEnd, const TShape& fittingShape)
 {
-	float numMeasurements = FLT_MIN;
-	float sumError2 = 0.0f;
+	MonotonicArena::Scope scratch;
+	LineSamples samples(scratch.getArena());
+	sampleLine(line, tStart, tStep, tEnd, &samples);
+	return calcMeanSquaredError(samples, fittingShape);
+}
 
-	for (float tCurr = tStart; tCurr < tEnd; tCurr += tStep, numMeasurements += 1.0f)
+template <class TShape> float ArcSplineUtil::calcMeanSquaredError(const LineSamples& samples, const TShape& fittingShape)
+{
+	float numMeasurements = float(samples.size()) + FLT_MIN;
+	return ErrorKernels::sumSquaredDist(samples, fittingShape) / numMeasurements;
+}
+
+void ArcSplineUtil::sampleLine(const FreeformLine& line, float tStart, float tStep, float tEnd, LineSamples* result)
+{
+	result->clear();
+	FreeformLine::Cursor cursor(line);
+	for (float tCurr = tStart; tCurr < tEnd; tCurr += tStep)
 	{
-		Vector2 pointOnLine = line.getPointAt(tCurr);
-		float signedDist = fittingShape.signedDistTo(pointOnLine);
-		sumError2 += signedDist * signedDist;
+		result->add(cursor.getPointAt(tCurr));
 	}
-
-	return sumError2 / numMeasurements;
 }
 
 float ArcSplineUtil::minDistToBiarcMidPoint(const FreeformLine& line, float tStart, float tStep, float tEnd, const Biarc& biarc)
@@ -135,11 +296,26 @@ float ArcSplineUtil::minDistToBiarcMidPoint(const FreeformLine& line, float tSta
 		}
 	}
 	float minDist2 = FLT_MAX;
+	FreeformLine::Cursor cursor(line);
 	for (float tCurr = tStart; tCurr < tEnd; tCurr += tStep)
 	{
-		Vector2 pointOnLine = line.getPointAt(tCurr);
+		Vector2 pointOnLine = cursor.getPointAt(tCurr);
 		float dist2 = (pointOnLine - midPoint).norm2();
 		if (dist2 < minDist2) { minDist2 = dist2; }
 	}
 	return std::sqrt(minDist2);
 }
+
+// Instantiate corner detection for both kinds of result lists
+template void ArcSplineUtil::findCorners<std::vector<Range>>(const FreeformLineSection&, const CornersInput&, std::vector<Range>*);
+template void ArcSplineUtil::findCorners<ArenaVector<Range>>(const FreeformLineSection&, const CornersInput&, ArenaVector<Range>*);
+
+// Instantiate error calculation for all fitting shapes
+template float ArcSplineUtil::calcMeanSquaredError<Line>(const FreeformLine&, float, float, float, const Line&);
+template float ArcSplineUtil::calcMeanSquaredError<Circle>(const FreeformLine&, float, float, float, const Circle&);
+template float ArcSplineUtil::calcMeanSquaredError<CircleOrLine>(const FreeformLine&, float, float, float, const CircleOrLine&);
+template float ArcSplineUtil::calcMeanSquaredError<Biarc>(const FreeformLine&, float, float, float, const Biarc&);
+template float ArcSplineUtil::calcMeanSquaredError<Line>(const LineSamples&, const Line&);
+template float ArcSplineUtil::calcMeanSquaredError<Circle>(const LineSamples&, const Circle&);
+template float ArcSplineUtil::calcMeanSquaredError<CircleOrLine>(const LineSamples&, const CircleOrLine&);
+template float ArcSplineUtil::calcMeanSquaredError<Biarc>(const LineSamples&, const Biarc&);
@@ -4,6 +4,8 @@
 
 struct Biarc;
 class FreeformLine;
+class FreeformLineSection;
+struct LineSamples;
 
 // Utility for constructing ArcSpline from a FreeformLine
 //
@@ -36,6 +38,19 @@ struct ArcSplineUtil
 		// Don't touch. Distance factors for choosing angle-measurement points.
 		float innerInterMeasurementFactor = 1.0f;
 		float outerInterMeasurementFactor = 2.0f;
+
+		// Test only where a coarse pass over a StrokePyramid finds the tangent turning, instead of at every step. Makes long strokes cost about as much as their corners; very noisy strokes may lose a few weak corners, so it's off by default.
+		bool coarseToFine = false;
+
+		// Compare all settings; used to check if cached corners are still valid
+		bool operator == (const CornersInput& b) const
+		{
+			return tStep == b.tStep && innerMinAngleInDeg == b.innerMinAngleInDeg && outerMaxAngleInDeg == b.outerMaxAngleInDeg &&
+				minNumberTestPositivesInSeries == b.minNumberTestPositivesInSeries && maxDistBetweenCornersToMerge == b.maxDistBetweenCornersToMerge &&
+				innerInterMeasurementFactor == b.innerInterMeasurementFactor && outerInterMeasurementFactor == b.outerInterMeasurementFactor &&
+				coarseToFine == b.coarseToFine;
+		}
+		bool operator != (const CornersInput& b) const { return !operator == (b); }
 	};
 
 	// Input for checking if a line section qualifies as a segment
@@ -49,14 +64,15 @@ struct ArcSplineUtil
 
 		// Don't touch. Reference length used to compute maxMeanError
 		float referenceSegmentLength = 20.0f;
+
+		// Compare all settings; used to check if cached segments are still valid
+		bool operator == (const SegmentsInput& b) const { return tStep == b.tStep && maxMeanErrorAtReferenceLength == b.maxMeanErrorAtReferenceLength && referenceSegmentLength == b.referenceSegmentLength; }
+		bool operator != (const SegmentsInput& b) const { return !operator == (b); }
 	};
 
 	// Input for generating biarc-splines for line sections
 	struct BiarcsInput
 	{
-		// Runtime data, ignore it here
-		Range tBounds;
-
 		// Processing step. We only look at the few points equally spaced along a line section.
 		float tStep = 15.0f;
 
@@ -91,7 +107,7 @@ struct ArcSplineUtil
 	};
 
 	// Combined input for all processing.
-	struct ProcessingInput : RefCounted
+	struct ProcessingInput : ThreadSafeRefCounted
 	{
 		CornersInput corners;
 		SegmentsInput segments;
@@ -101,9 +117,14 @@ struct ArcSplineUtil
 	// Find corners.
 	//
 	// Corners are found as sections where tangent changes significantly, but stays relatively constant farther away in each direction.
-	static void findCorners(const FreeformLine& line, const CornersInput& input, std::vector<Range>* result);
+	// Scans within section.getBounds() & reads tangents from section.getTangentField(). With input.coarseToFine, only windows where a
+	// StrokePyramid shows the tangent turning are scanned, and without the section's tangent field, one is sampled for each window.
+	// Scratch data comes from section.getArena(). Corners are appended to the result, a std::vector<Range> or an ArenaVector<Range>.
+	template <class TRanges> static void findCorners(const FreeformLineSection& section, const CornersInput& input, TRanges* result);
 
-	// Check if a segment is a satisfactory approximation of a line section
+	// Check if a segment is a satisfactory approximation of a line section.
+	//
+	// The error is measured at every input.tStep, or, if the line keeps moments, averaged over the whole section in constant time.
 	static bool isSegment(const FreeformLine& line, const Range segmentBounds, const SegmentsInput& input, float* outMeanError2);
 
 	// Convert a line section into a series of biarcs.
@@ -121,13 +142,25 @@ struct ArcSplineUtil
 	// found its error is modified to favor such solutions. Also error balancing is
 	// turned off if a biarc can reach the end of the line. That limits occurrence of
 	// oddly-looking short final arcs.
-	static void convertLineToBiarcs(const FreeformLine& line, const BiarcsInput& input, std::vector<Biarc>* result);
+	//
+	// The section is converted within section.getBounds(), and biarc end tangents are read with
+	// section.getTangentAt(). The function only reads the section & input, so different sections
+	// of one line can be converted concurrently.
+	static void convertLineToBiarcs(const FreeformLineSection& section, const BiarcsInput& input, std::vector<Biarc>* result);
 
 	// Calculate error between the FreeformLine & a fitting shape.
 	//
 	// This is estimated by measuring distance between points along the FreeformLine section and the fittingShape.
 	template <class TShape> static float calcMeanSquaredError(const FreeformLine& line, float tStart, float tStep, float tEnd, const TShape& fittingShape);
 
+	// Calculate error between pre-sampled points of a FreeformLine & a fitting shape, using vectorized ErrorKernels.
+	//
+	// Sample the line once with sampleLine(), when measuring the error of several shapes over the same section.
+	template <class TShape> static float calcMeanSquaredError(const LineSamples& samples, const TShape& fittingShape);
+
+	// Sample points along the FreeformLine section, at the same 't' values calcMeanSquaredError() measures.
+	static void sampleLine(const FreeformLine& line, float tStart, float tStep, float tEnd, LineSamples* result);
+
 	// Calculate distance between biarc midpoint & the line. 
 	//
 	// This is a last-moment fix up for some incorrect biarc results.
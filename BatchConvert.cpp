@@ -0,0 +1,343 @@
+#include "FreeformTool.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ArcSpline.h"
+#include "ArcSplineUtil.h"
+#include "BulkLoader.h"
+#include "Common.h"
+#include "Instrumentation.h"
+#include "SplineCache.h"
+#include "StrokeArchive.h"
+#include "StrokeProcessor.h"
+#include "ThreadPool.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+This is the headless command-line driver of the arc-spline conversion, for
+running batch jobs without a window.
+
+It reads stroke files, either StrokeArchives or the text format, converts all
+strokes with a BulkLoader & writes the resulting splines as text, one element
+per line:
+  stroke <index> <number of shapes> <number of corners>
+  arc <center x> <center y> <radius> <start angle> <sweep angle>
+  segment <x0> <y0> <x1> <y1>
+  corner <x> <y>
+
+Throughput of the whole run, and optionally of each stroke, goes to stderr.
+When built with instrumentation, time spent in each stage & event counts are
+reported too, and --trace writes a Chrome trace of all stages.
+
+With --replay, the input points of all strokes are also fed through a
+StrokeProcessor by a synthetic producer thread, as if they were drawn at the
+given rate. Backpressure stats are reported, along with strokes whose grown
+line differs from the original, e.g. because points were dropped.
+
+With --cache, strokes with a result stored for the same settings in the given
+SplineCache skip the conversion, and all results are stored in it afterwards.
+Run with --help for the list of options & ProcessingInput settings.
+
+See: BulkLoader, ArcSpline, StrokeArchive
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// A ProcessingInput setting that can be changed from the command line
+struct Setting
+{
+	enum Type { TYPE_FLOAT, TYPE_UINT, TYPE_INT, TYPE_BOOL } type;
+	const char* name;
+	void* variable;
+};
+
+// List all ProcessingInput settings
+static std::vector<Setting> getSettings(ArcSplineUtil::ProcessingInput* input)
+{
+	ArcSplineUtil::CornersInput& c = input->corners;
+	ArcSplineUtil::SegmentsInput& s = input->segments;
+	ArcSplineUtil::BiarcsInput& b = input->biarcs;
+	return std::vector<Setting> {
+		{ Setting::TYPE_FLOAT, "corners.tStep", &c.tStep },
+		{ Setting::TYPE_FLOAT, "corners.innerMinAngleInDeg", &c.innerMinAngleInDeg },
+		{ Setting::TYPE_FLOAT, "corners.outerMaxAngleInDeg", &c.outerMaxAngleInDeg },
+		{ Setting::TYPE_UINT, "corners.minNumberTestPositivesInSeries", &c.minNumberTestPositivesInSeries },
+		{ Setting::TYPE_UINT, "corners.maxDistBetweenCornersToMerge", &c.maxDistBetweenCornersToMerge },
+		{ Setting::TYPE_FLOAT, "corners.innerInterMeasurementFactor", &c.innerInterMeasurementFactor },
+		{ Setting::TYPE_FLOAT, "corners.outerInterMeasurementFactor", &c.outerInterMeasurementFactor },
+		{ Setting::TYPE_BOOL, "corners.coarseToFine", &c.coarseToFine },
+		{ Setting::TYPE_FLOAT, "segments.tStep", &s.tStep },
+		{ Setting::TYPE_FLOAT, "segments.maxMeanErrorAtReferenceLength", &s.maxMeanErrorAtReferenceLength },
+		{ Setting::TYPE_FLOAT, "segments.referenceSegmentLength", &s.referenceSegmentLength },
+		{ Setting::TYPE_FLOAT, "biarcs.tStep", &b.tStep },
+		{ Setting::TYPE_FLOAT, "biarcs.maxMeanError", &b.maxMeanError },
+		{ Setting::TYPE_FLOAT, "biarcs.maxBiarcRatio", &b.maxBiarcRatio },
+		{ Setting::TYPE_FLOAT, "biarcs.minBiarcRatio", &b.minBiarcRatio },
+		{ Setting::TYPE_INT, "biarcs.numBiarcRatioSamples", &b.numBiarcRatioSamples },
+		{ Setting::TYPE_FLOAT, "biarcs.distToErrorThreshold", &b.distToErrorThreshold },
+		{ Setting::TYPE_FLOAT, "biarcs.endOfLineOkayFactor", &b.endOfLineOkayFactor },
+		{ Setting::TYPE_BOOL, "biarcs.allowHalfArcAtSectionEnd", &b.allowHalfArcAtSectionEnd },
+		{ Setting::TYPE_FLOAT, "biarcs.endAngleTolerance", &b.endAngleTolerance },
+		{ Setting::TYPE_BOOL, "biarcs.allowExtraToleranceForSingleArcSections", &b.allowExtraToleranceForSingleArcSections },
+		{ Setting::TYPE_FLOAT, "biarcs.endAngleToleranceForSingleArcSection", &b.endAngleToleranceForSingleArcSection },
+	};
+}
+
+// Apply a "name=value" assignment to a setting; returns false if the name is unknown or the value can't be parsed
+static bool applySetting(const std::vector<Setting>& settings, const char* assignment)
+{
+	const char* separator = std::strchr(assignment, '=');
+	if (!separator) { return false; }
+	const std::string name(assignment, separator);
+	const char* value = separator + 1;
+	char* end = nullptr;
+
+	for (const Setting& s : settings)
+	{
+		if (name != s.name) { continue; }
+		switch (s.type)
+		{
+		case Setting::TYPE_FLOAT: *static_cast<float*>(s.variable) = std::strtof(value, &end); break;
+		case Setting::TYPE_UINT: *static_cast<unsigned int*>(s.variable) = (unsigned int)std::strtoul(value, &end, 10); break;
+		case Setting::TYPE_INT: *static_cast<int*>(s.variable) = (int)std::strtol(value, &end, 10); break;
+		case Setting::TYPE_BOOL: *static_cast<bool*>(s.variable) = 0 != std::strtol(value, &end, 10); break;
+		}
+		return end != value && *end == '\0';
+	}
+	return false;
+}
+
+// Print usage & all settings with their default values
+static void printUsage(const std::vector<Setting>& settings)
+{
+	std::fprintf(stderr,
+		"Usage: FreeformConvert [options] <stroke file>...\n"
+		"Converts strokes into arc-splines. Stroke files are StrokeArchives or text files saved by FreeformTool.\n"
+		"\n"
+		"Options:\n"
+		"  -o <file>           Write splines to a file instead of stdout\n"
+		"  --no-output         Only convert & report throughput\n"
+		"  --threads <n>       Number of worker threads besides the main thread; default uses all cores\n"
+		"  --set <name>=<val>  Change a ProcessingInput setting; may be repeated\n"
+		"  --verbose           Report throughput of each stroke\n"
+		"  --trace <file>      Write a Chrome trace of all stages; needs a build with instrumentation\n"
+		"  --replay <rate>     Also draw the strokes through a StrokeProcessor at rate points/s; 0 for as fast as possible\n"
+		"  --cache <file>      Take results from a spline cache & store all results in it\n"
+		"  --moments           Keep moment tables of the lines, for constant-time segment checks\n"
+		"\n"
+		"Settings & defaults:\n");
+	for (const Setting& s : settings)
+	{
+		switch (s.type)
+		{
+		case Setting::TYPE_FLOAT: std::fprintf(stderr, "  %s=%g\n", s.name, *static_cast<float*>(s.variable)); break;
+		case Setting::TYPE_UINT: std::fprintf(stderr, "  %s=%u\n", s.name, *static_cast<unsigned int*>(s.variable)); break;
+		case Setting::TYPE_INT: std::fprintf(stderr, "  %s=%d\n", s.name, *static_cast<int*>(s.variable)); break;
+		case Setting::TYPE_BOOL: std::fprintf(stderr, "  %s=%d\n", s.name, *static_cast<bool*>(s.variable) ? 1 : 0); break;
+		}
+	}
+}
+
+// Write shapes & corners of a spline
+static void writeSpline(std::FILE* out, int idx, const ArcSpline& spline)
+{
+	const ref<const SplineResult> result = spline.getResult();
+	std::fprintf(out, "stroke %d %d %d\n", idx, (int)result->displayShapes.size(), (int)result->debugCorners.size());
+	for (const SplineElement& e : result->displayShapes)
+	{
+		switch (e.type)
+		{
+		case SplineElement::TYPE_ARC: std::fprintf(out, "arc %g %g %g %g %g\n", e.circle.x, e.circle.y, e.circle.radius, e.startAngle, e.sweepAngle); break;
+		case SplineElement::TYPE_SEGMENT: std::fprintf(out, "segment %g %g %g %g\n", e.p0.x, e.p0.y, e.p1.x, e.p1.y); break;
+		default: break;
+		}
+	}
+	for (const Vector2& c : result->debugCorners) { std::fprintf(out, "corner %g %g\n", c.x, c.y); }
+}
+
+// Load & convert strokes of a file, either a StrokeArchive or text; returns false if the file can't be read
+static bool convertFile(BulkLoader* loader, const char* fileName, std::vector<ref<ArcSpline>>* result)
+{
+	StrokeArchive archive(fileName);
+	if (archive.isValid())
+	{
+		loader->load(archive, result);
+		return true;
+	}
+
+	std::ifstream stream(fileName);
+	return stream && loader->load(stream, result);
+}
+
+// Check if two lines have the same points
+static bool hasSamePoints(const FreeformLine& a, const FreeformLine& b)
+{
+	if (a.numPoints() != b.numPoints() || a.length() != b.length()) { return false; }
+	for (int i = 0; i < a.numPoints(); i++)
+	{
+		if (a.getInputPoint(i).x != b.getInputPoint(i).x || a.getInputPoint(i).y != b.getInputPoint(i).y) { return false; }
+	}
+	return true;
+}
+
+// Draw the strokes of splines through a processor, with a producer thread queuing their points at pointsPerSecond, or as fast as possible if 0. Returns the number of strokes that came out different.
+static int replayStrokes(StrokeProcessor* processor, const std::vector<ref<ArcSpline>>& splines, double pointsPerSecond)
+{
+	int numDifferent = 0;
+	for (const ArcSpline* spline : splines)
+	{
+		const FreeformLine& source = *spline->sourceLine;
+		if (source.numPoints() < 3) { continue; }
+		ref<FreeformLine> line = make_ref<FreeformLine>();
+		line->halfSmoothingSpread = source.halfSmoothingSpread;
+		line->tangentFieldResolution = source.tangentFieldResolution;
+		line->addPoint(source.getInputPoint(1));
+		processor->beginStroke(line, make_ref<ArcSpline>(line));
+
+		std::thread producer([&]()
+		{
+			const double startTime = InputQueue::getTime();
+			for (int i = 2; i < source.numPoints() - 1; i++)
+			{
+				const double time = startTime + double(i - 2) / pointsPerSecond;
+				while (0.0 < pointsPerSecond && InputQueue::getTime() < time) { std::this_thread::yield(); }
+				processor->addPoint(source.getInputPoint(i), InputQueue::getTime());
+			}
+		});
+		producer.join();
+		processor->endStroke();
+		if (!hasSamePoints(*line, source)) { numDifferent++; }
+	}
+	return numDifferent;
+}
+
+int main(int argc, char* argv[])
+{
+	ArcSplineUtil::ProcessingInput processingInput;
+	const std::vector<Setting> settings = getSettings(&processingInput);
+
+	// Parse arguments
+	std::vector<const char*> inputFiles;
+	const char* outputFile = nullptr;
+	const char* traceFile = nullptr;
+	const char* cacheFile = nullptr;
+	bool isOutputEnabled = true;
+	bool isVerbose = false;
+	bool areMomentsKept = false;
+	int numThreads = -1;
+	double replayRate = -1.0;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (0 == std::strcmp(arg, "-o") && hasValue) { outputFile = argv[++i]; }
+		else if (0 == std::strcmp(arg, "--no-output")) { isOutputEnabled = false; }
+		else if (0 == std::strcmp(arg, "--threads") && hasValue) { numThreads = std::atoi(argv[++i]); }
+		else if (0 == std::strcmp(arg, "--verbose")) { isVerbose = true; }
+		else if (0 == std::strcmp(arg, "--trace") && hasValue) { traceFile = argv[++i]; }
+		else if (0 == std::strcmp(arg, "--replay") && hasValue) { replayRate = std::atof(argv[++i]); }
+		else if (0 == std::strcmp(arg, "--cache") && hasValue) { cacheFile = argv[++i]; }
+		else if (0 == std::strcmp(arg, "--moments")) { areMomentsKept = true; }
+		else if (0 == std::strcmp(arg, "--set") && hasValue)
+		{
+			if (!applySetting(settings, argv[++i])) { std::fprintf(stderr, "Invalid setting: %s\n", argv[i]); return 2; }
+		}
+		else if (0 == std::strcmp(arg, "--help") || arg[0] == '-') { printUsage(settings); return arg[0] == '-' && 0 != std::strcmp(arg, "--help") ? 2 : 0; }
+		else { inputFiles.push_back(arg); }
+	}
+	if (inputFiles.empty()) { printUsage(settings); return 2; }
+
+	std::FILE* out = nullptr;
+	if (isOutputEnabled)
+	{
+		out = outputFile ? std::fopen(outputFile, "w") : stdout;
+		if (!out) { std::fprintf(stderr, "Can't open %s\n", outputFile); return 1; }
+	}
+
+	if (traceFile) { Instrumentation::setTracingEnabled(true); }
+
+	// Convert files one by one, on a dedicated pool if the number of threads is set
+	ThreadPool* customPool = numThreads >= 0 ? new ThreadPool(numThreads) : nullptr;
+	ThreadPool& pool = customPool ? *customPool : ThreadPool::getShared();
+	BulkLoader loader(pool);
+	loader.processingInput = processingInput;
+	const SplineCache* cache = cacheFile ? new SplineCache(cacheFile) : nullptr;
+	loader.cache = cache;
+	loader.isCachedInputMatched = true;
+	loader.areMomentsKept = areMomentsKept;
+	std::vector<ref<ArcSpline>> allSplines;
+
+	StrokeProcessor* processor = 0.0 <= replayRate ? new StrokeProcessor() : nullptr;
+	int numStrokes = 0, numCached = 0, numDifferentReplays = 0, exitCode = 0;
+	long long numPoints = 0;
+	double readSeconds = 0.0, convertSeconds = 0.0;
+	for (const char* fileName : inputFiles)
+	{
+		std::vector<ref<ArcSpline>> splines;
+		if (!convertFile(&loader, fileName, &splines)) { std::fprintf(stderr, "Can't read %s\n", fileName); exitCode = 1; }
+		readSeconds += loader.getParseSeconds();
+		convertSeconds += loader.getConvertSeconds();
+
+		for (size_t i = 0; i < splines.size(); i++)
+		{
+			const BulkLoader::StrokeTiming& timing = loader.getStrokeTimings()[i];
+			numPoints += timing.numPoints;
+			if (timing.isCached) { numCached++; }
+			if (isVerbose)
+			{
+				std::fprintf(stderr, "%s #%d: %d points, length %.1f, %.3f ms, %.0f points/s\n", fileName, (int)i, timing.numPoints, timing.length,
+					timing.convertSeconds * 1000.0, timing.numPoints / (timing.convertSeconds + DBL_MIN));
+			}
+			if (out) { writeSpline(out, numStrokes + (int)i, *splines[i]); }
+		}
+		numStrokes += (int)splines.size();
+		if (cache) { allSplines.insert(allSplines.end(), splines.begin(), splines.end()); }
+		if (processor) { numDifferentReplays += replayStrokes(processor, splines, replayRate); }
+	}
+
+	std::fprintf(stderr, "%d strokes, %lld points, %d threads: reading %.1f ms, conversion %.1f ms, %.1f strokes/s, %.0f points/s\n",
+		numStrokes, numPoints, pool.getNumWorkers() + 1, readSeconds * 1000.0, convertSeconds * 1000.0,
+		numStrokes / (convertSeconds + DBL_MIN), numPoints / (convertSeconds + DBL_MIN));
+
+	if (cache)
+	{
+		std::fprintf(stderr, "Cache %s: %d of %d strokes cached\n", cacheFile, numCached, numStrokes);
+		delete cache;
+		if (!SplineCache::write(cacheFile, allSplines)) { std::fprintf(stderr, "Can't write %s\n", cacheFile); exitCode = 1; }
+	}
+
+	if (processor)
+	{
+		const StrokeProcessor::Stats stats = processor->getStats();
+		std::fprintf(stderr, "Replay at %g points/s: %llu points queued, %llu dropped, max queue %d, %llu batches, max batch %d, max latency %.2f ms, %d strokes differ\n",
+			replayRate, (unsigned long long)stats.queue.numPushed, (unsigned long long)stats.queue.numDropped, stats.queue.maxOccupancy,
+			(unsigned long long)stats.numBatches, stats.maxBatchSize, stats.maxLatency * 1000.0, numDifferentReplays);
+	}
+
+#if ME_ENABLE_INSTRUMENTATION
+	const SplineStats stats = Instrumentation::getGlobalStats();
+	for (int i = 0; i < SplineStats::NUM_STAGES; i++)
+	{
+		const SplineStats::Stage stage = SplineStats::Stage(i);
+		std::fprintf(stderr, "  %-24s %10.1f ms %10llu runs\n", SplineStats::getName(stage), stats.stageNs[i] * 1e-6, (unsigned long long)stats.stageRuns[i]);
+	}
+	for (int i = 0; i < SplineStats::NUM_COUNTERS; i++)
+	{
+		std::fprintf(stderr, "  %-24s %13llu\n", SplineStats::getName(SplineStats::Counter(i)), (unsigned long long)stats.counters[i]);
+	}
+#endif
+	if (traceFile)
+	{
+		std::ofstream trace(traceFile);
+		Instrumentation::writeChromeTrace(trace);
+		if (!trace) { std::fprintf(stderr, "Can't write %s\n", traceFile); exitCode = 1; }
+	}
+
+	if (out && out != stdout) { std::fclose(out); }
+	delete processor;
+	delete customPool;
+	return exitCode;
+}
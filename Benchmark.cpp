@@ -0,0 +1,390 @@
+#include "FreeformTool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "ArcSpline.h"
+#include "ArcSplineUtil.h"
+#include "Common.h"
+#include "FreeformLine.h"
+#include "FreeformLineSection.h"
+#include "Geometry.h"
+#include "InputQueue.h"
+#include "MonotonicArena.h"
+#include "SimdFloat.h"
+#include "ThreadPool.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+This is the microbenchmark suite of the geometry & fitting primitives, and of
+the whole spline conversion.
+
+Strokes are generated synthetically & deterministically: a mouse-like walk on
+the integer pixel grid, with gentle curves and a sharp turn every few hundred
+points. Each benchmark runs on strokes of several lengths, 100 to 100k points
+by default. Benchmarks of single shapes don't depend on the stroke length &
+run once, with points reported as 0.
+
+Every measurement is calibrated to run for at least --min-time seconds, and
+repeated --repetitions times. The median, min & max time per operation are
+written as JSON or CSV, so runs can be compared by scripts. What counts as an
+operation is part of each benchmark's name.
+
+Run with --help for the list of options.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+typedef std::chrono::steady_clock Clock;
+
+// Results of one benchmark at one stroke length
+struct BenchmarkResult
+{
+	std::string name;
+	int numPoints;
+	long long iterations;
+	double nsPerOp, minNsPerOp, maxNsPerOp;
+};
+
+// Benchmark settings
+struct BenchmarkOptions
+{
+	double minTimeSeconds = 0.2;
+	int repetitions = 3;
+	std::vector<int> lengths = { 100, 1000, 10000, 100000 };
+	std::string filter;
+};
+
+// Consumes benchmark results, so the compiler can't drop the measured work
+static volatile float g_sink;
+
+// Generate a deterministic mouse-like stroke
+static ref<FreeformLine> generateStroke(int numPoints, unsigned int seed)
+{
+	ref<FreeformLine> line = new FreeformLine();
+	unsigned int state = seed;
+	auto random = [&state]() { state = state * 1103515245u + 12345u; return float((state >> 16) & 0x7fff) / 32768.0f; };
+
+	Vector2 point(500.0f, 500.0f);
+	float heading = 0.0f, turnRate = 0.0f;
+	line->addPoint(point);
+	while (line->numPoints() - 2 < numPoints)
+	{
+		// Curve gently, turn sharply now & then
+		if (random() < 0.004f) { heading += (random() < 0.5f ? -1.0f : 1.0f) * (1.2f + random()); }
+		turnRate = getClipped(turnRate + 0.004f * (random() - 0.5f), -0.02f, 0.02f);
+		heading += turnRate;
+
+		const Vector2 next = point + Vector2(std::cos(heading), std::sin(heading)) * (1.0f + 2.0f * random());
+		if (std::floor(next.x) != std::floor(point.x) || std::floor(next.y) != std::floor(point.y))
+		{
+			line->addPoint(Vector2(std::floor(next.x), std::floor(next.y)));
+		}
+		point = next;
+	}
+	return line;
+}
+
+// Run op(iterations) repeatedly, calibrated to the minimum time
+static BenchmarkResult measure(const BenchmarkOptions& options, const char* name, int numPoints, const std::function<void(long long)>& op)
+{
+	// Find the number of iterations that takes long enough
+	long long iterations = 1;
+	for (;;)
+	{
+		const Clock::time_point start = Clock::now();
+		op(iterations);
+		const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+		if (seconds >= options.minTimeSeconds || iterations >= (1ll << 40)) { break; }
+		const double scale = seconds > 0.0 ? 1.4 * options.minTimeSeconds / seconds : 100.0;
+		iterations = std::max(iterations + 1, (long long)(iterations * std::min(scale, 100.0)));
+	}
+
+	// Repeat at that number of iterations
+	std::vector<double> nsPerOp;
+	for (int i = 0; i < options.repetitions; i++)
+	{
+		const Clock::time_point start = Clock::now();
+		op(iterations);
+		nsPerOp.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() / double(iterations));
+	}
+	std::sort(nsPerOp.begin(), nsPerOp.end());
+
+	BenchmarkResult result;
+	result.name = name;
+	result.numPoints = numPoints;
+	result.iterations = iterations;
+	result.nsPerOp = nsPerOp[nsPerOp.size() / 2];
+	result.minNsPerOp = nsPerOp.front();
+	result.maxNsPerOp = nsPerOp.back();
+	return result;
+}
+
+// Pseudo-random 't' values along the line
+static std::vector<float> generateQueries(const FreeformLine& line, int count)
+{
+	std::vector<float> result;
+	unsigned int state = 7;
+	for (int i = 0; i < count; i++)
+	{
+		state = state * 1103515245u + 12345u;
+		result.push_back(line.length() * float((state >> 8) & 0xffff) / 65535.0f);
+	}
+	return result;
+}
+
+// Run all benchmarks that match the filter
+static void runBenchmarks(const BenchmarkOptions& options, std::vector<BenchmarkResult>* results)
+{
+	auto isEnabled = [&options](const char* name) { return options.filter.empty() || std::strstr(name, options.filter.c_str()); };
+	auto run = [&](const char* name, int numPoints, const std::function<void(long long)>& op)
+	{
+		if (!isEnabled(name)) { return; }
+		results->push_back(measure(options, name, numPoints, op));
+		const BenchmarkResult& r = results->back();
+		std::fprintf(stderr, "%-50s %7d points %14.1f ns/op\n", r.name.c_str(), r.numPoints, r.nsPerOp);
+	};
+
+	// Benchmarks over whole strokes
+	for (int numPoints : options.lengths)
+	{
+		const ref<FreeformLine> line = generateStroke(numPoints, 1);
+		const Range lineBounds(0.0f, line->length());
+		const FreeformLineSection section(*line, lineBounds);
+		const std::vector<float> queries = generateQueries(*line, 1024);
+
+		run("FreeformLine::getPointAt (1 random query)", numPoints, [&](long long n)
+		{
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++) { sum += line->getPointAt(queries[i & 1023]).x; }
+			g_sink = sum;
+		});
+		run("FreeformLine::addPoint (whole line)", numPoints, [&](long long n)
+		{
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++)
+			{
+				FreeformLine copy;
+				for (int idx = 1; idx < line->numPoints() - 1; idx++) { copy.addPoint(line->getInputPoint(idx)); }
+				sum += copy.length();
+			}
+			g_sink = sum;
+		});
+		run("FreeformLine::addPoint (whole line, decimated)", numPoints, [&](long long n)
+		{
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++)
+			{
+				FreeformLine copy;
+				copy.decimationTolerance = 0.5f;
+				for (int idx = 1; idx < line->numPoints() - 1; idx++) { copy.addPoint(line->getInputPoint(idx)); }
+				sum += float(copy.numPoints());
+			}
+			g_sink = sum;
+		});
+		run("FreeformLineSection::getTangentAt (1 random query)", numPoints, [&](long long n)
+		{
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++) { sum += section.getTangentAt(queries[i & 1023]).x; }
+			g_sink = sum;
+		});
+		run("FreeformLine::Cursor::getPointAt (whole line, step 1)", numPoints, [&](long long n)
+		{
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++)
+			{
+				FreeformLine::Cursor cursor(*line);
+				for (float t = 0.0f; t < lineBounds.end; t += 1.0f) { sum += cursor.getPointAt(t).x; }
+			}
+			g_sink = sum;
+		});
+		run("FreeformLineSection (whole line, with tangent field)", numPoints, [&](long long n)
+		{
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++) { FreeformLineSection s(*line, lineBounds); sum += s.getTangentField().getTangentAt(0.0f).x; }
+			g_sink = sum;
+		});
+		run("ArcSplineUtil::findCorners (whole line)", numPoints, [&](long long n)
+		{
+			ArcSplineUtil::CornersInput input;
+			std::vector<Range> corners;
+			for (long long i = 0; i < n; i++) { corners.clear(); ArcSplineUtil::findCorners(section, input, &corners); }
+			g_sink = float(corners.size());
+		});
+		run("ArcSplineUtil::findCorners (whole line, coarse-to-fine)", numPoints, [&](long long n)
+		{
+			ArcSplineUtil::CornersInput input;
+			input.coarseToFine = true;
+			std::vector<Range> corners;
+			for (long long i = 0; i < n; i++)
+			{
+				MonotonicArena::Scope scope;
+				FreeformLineSection s(*line, lineBounds, false, scope.getArena());
+				corners.clear();
+				ArcSplineUtil::findCorners(s, input, &corners);
+			}
+			g_sink = float(corners.size());
+		});
+		run("ArcSplineUtil::isSegment (whole line)", numPoints, [&](long long n)
+		{
+			ArcSplineUtil::SegmentsInput input;
+			float meanError2 = 0.0f, sum = 0.0f;
+			for (long long i = 0; i < n; i++) { sum += ArcSplineUtil::isSegment(*line, lineBounds, input, &meanError2) ? 1.0f : meanError2; }
+			g_sink = sum;
+		});
+		run("ArcSplineUtil::isSegment (whole line, moments)", numPoints, [&](long long n)
+		{
+			FreeformLine momentsLine(*line);
+			momentsLine.setMomentsKept(true);
+			ArcSplineUtil::SegmentsInput input;
+			float meanError2 = 0.0f, sum = 0.0f;
+			for (long long i = 0; i < n; i++) { sum += ArcSplineUtil::isSegment(momentsLine, lineBounds, input, &meanError2) ? 1.0f : meanError2; }
+			g_sink = sum;
+		});
+		run("ArcSplineUtil::calcMeanSquaredError<Line> (whole line, step 15)", numPoints, [&](long long n)
+		{
+			const Line fitLine = Line::between(line->getPointAt(0.0f), line->getPointAt(lineBounds.end));
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++) { sum += ArcSplineUtil::calcMeanSquaredError(*line, 0.0f, 15.0f, lineBounds.end, fitLine); }
+			g_sink = sum;
+		});
+		run("ArcSpline::ArcSpline (whole line)", numPoints, [&](long long n)
+		{
+			float sum = 0.0f;
+			for (long long i = 0; i < n; i++) { ref<ArcSpline> spline = new ArcSpline(line); sum += float(spline->getResult()->displayShapes.size()); }
+			g_sink = sum;
+		});
+		run("ArcSpline::recreateSpline (whole line, cached corners)", numPoints, [&](long long n)
+		{
+			ref<ArcSpline> spline = new ArcSpline(line);
+			for (long long i = 0; i < n; i++) { spline->recreateSpline(); }
+			g_sink = float(spline->getResult()->displayShapes.size());
+		});
+	}
+
+	// Benchmarks of single shapes
+	const ref<FreeformLine> line = generateStroke(1000, 2);
+	const FreeformLineSection section(*line, Range(0.0f, line->length()), false);
+	const ArcSplineUtil::BiarcsInput biarcsInput;
+	Biarc biarc;
+	biarc.point0 = line->getPointAt(100.0f); biarc.tangent0 = section.getTangentAt(100.0f);
+	biarc.point1 = line->getPointAt(160.0f); biarc.tangent1 = section.getTangentAt(160.0f);
+	std::vector<Biarc::DParam> params;
+	Biarc::findPossibleBiarcParams(biarc, biarcsInput.minBiarcRatio, biarcsInput.maxBiarcRatio, biarcsInput.numBiarcRatioSamples, true, &params);
+
+	run("CircleOrLine::fitCircleOrLine", 0, [&](long long n)
+	{
+		CircleOrLine shape;
+		float sum = 0.0f;
+		for (long long i = 0; i < n; i++) { CircleOrLine::fitCircleOrLine(biarc.point0, biarc.tangent0, biarc.point1 + Vector2(0.0f, float(i & 7)), &shape); sum += shape.circle.radius; }
+		g_sink = sum;
+	});
+	run("Biarc::findPossibleBiarcParams (all ratios)", 0, [&](long long n)
+	{
+		std::vector<Biarc::DParam> result;
+		for (long long i = 0; i < n; i++) { result.clear(); Biarc::findPossibleBiarcParams(biarc, biarcsInput.minBiarcRatio, biarcsInput.maxBiarcRatio, biarcsInput.numBiarcRatioSamples, true, &result); }
+		g_sink = float(result.size());
+	});
+	run("Biarc::calcCachedShapes", 0, [&](long long n)
+	{
+		Biarc candidate = biarc;
+		float sum = 0.0f;
+		for (long long i = 0; i < n; i++) { candidate.param = params[i % params.size()]; candidate.calcCachedShapes(); sum += candidate.shape0.circle.radius; }
+		g_sink = sum;
+	});
+	run("InputQueue::push & pop (1 point)", 0, [&](long long n)
+	{
+		InputQueue queue(64);
+		InputPoint inputPoint = { Vector2::zero, 0.0 };
+		float sum = 0.0f;
+		for (long long i = 0; i < n; i++) { inputPoint.point.x = float(i & 7); queue.push(inputPoint); queue.pop(&inputPoint); sum += inputPoint.point.x; }
+		g_sink = sum;
+	});
+}
+
+// Write results as JSON
+static void writeJson(std::FILE* out, const BenchmarkOptions& options, const std::vector<BenchmarkResult>& results)
+{
+	std::fprintf(out, "{\n  \"context\": { \"simdWidth\": %d, \"numThreads\": %d, \"minTimeSeconds\": %g, \"repetitions\": %d },\n  \"benchmarks\": [\n",
+		SimdFloat::width, ThreadPool::getShared().getNumWorkers() + 1, options.minTimeSeconds, options.repetitions);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchmarkResult& r = results[i];
+		std::fprintf(out, "    { \"name\": \"%s\", \"points\": %d, \"iterations\": %lld, \"nsPerOp\": %.3f, \"minNsPerOp\": %.3f, \"maxNsPerOp\": %.3f }%s\n",
+			r.name.c_str(), r.numPoints, r.iterations, r.nsPerOp, r.minNsPerOp, r.maxNsPerOp, i + 1 < results.size() ? "," : "");
+	}
+	std::fprintf(out, "  ]\n}\n");
+}
+
+// Write results as CSV
+static void writeCsv(std::FILE* out, const std::vector<BenchmarkResult>& results)
+{
+	std::fprintf(out, "name,points,iterations,ns_per_op,min_ns_per_op,max_ns_per_op\n");
+	for (const BenchmarkResult& r : results)
+	{
+		std::fprintf(out, "\"%s\",%d,%lld,%.3f,%.3f,%.3f\n", r.name.c_str(), r.numPoints, r.iterations, r.nsPerOp, r.minNsPerOp, r.maxNsPerOp);
+	}
+}
+
+// Parse a comma-separated list of stroke lengths
+static bool parseLengths(const char* list, std::vector<int>* result)
+{
+	result->clear();
+	for (const char* s = list; *s; )
+	{
+		char* end = nullptr;
+		const long value = std::strtol(s, &end, 10);
+		if (end == s || value < 1) { return false; }
+		result->push_back((int)value);
+		s = *end == ',' ? end + 1 : end;
+		if (*end && *end != ',') { return false; }
+	}
+	return !result->empty();
+}
+
+int main(int argc, char* argv[])
+{
+	BenchmarkOptions options;
+	const char* format = "json";
+	const char* outputFile = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		const char* arg = argv[i];
+		const bool hasValue = i + 1 < argc;
+		if (0 == std::strcmp(arg, "--format") && hasValue) { format = argv[++i]; }
+		else if (0 == std::strcmp(arg, "-o") && hasValue) { outputFile = argv[++i]; }
+		else if (0 == std::strcmp(arg, "--filter") && hasValue) { options.filter = argv[++i]; }
+		else if (0 == std::strcmp(arg, "--min-time") && hasValue) { options.minTimeSeconds = std::atof(argv[++i]); }
+		else if (0 == std::strcmp(arg, "--repetitions") && hasValue) { options.repetitions = std::max(1, std::atoi(argv[++i])); }
+		else if (0 == std::strcmp(arg, "--lengths") && hasValue && parseLengths(argv[i + 1], &options.lengths)) { ++i; }
+		else
+		{
+			std::fprintf(stderr,
+				"Usage: FreeformBenchmark [options]\n"
+				"  --format json|csv     Output format; default json\n"
+				"  -o <file>             Write results to a file instead of stdout\n"
+				"  --filter <text>       Run only benchmarks whose name contains the text\n"
+				"  --lengths <n,n,...>   Stroke lengths in points; default 100,1000,10000,100000\n"
+				"  --min-time <seconds>  Minimum duration of each measurement; default 0.2\n"
+				"  --repetitions <n>     Measurements per benchmark, the median is reported; default 3\n");
+			return 0 == std::strcmp(arg, "--help") ? 0 : 2;
+		}
+	}
+	const bool isCsv = 0 == std::strcmp(format, "csv");
+	if (!isCsv && 0 != std::strcmp(format, "json")) { std::fprintf(stderr, "Unknown format: %s\n", format); return 2; }
+
+	std::FILE* out = outputFile ? std::fopen(outputFile, "w") : stdout;
+	if (!out) { std::fprintf(stderr, "Can't open %s\n", outputFile); return 1; }
+
+	std::vector<BenchmarkResult> results;
+	runBenchmarks(options, &results);
+	if (isCsv) { writeCsv(out, results); }
+	else { writeJson(out, options, results); }
+
+	if (out != stdout) { std::fclose(out); }
+	return 0;
+}
@@ -0,0 +1,96 @@
+#include "FreeformTool.h"
+#include "BulkLoader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <istream>
+#include <iterator>
+#include <mutex>
+
+#include "ArcSpline.h"
+#include "FreeformLine.h"
+#include "SplineCache.h"
+#include "StrokeArchive.h"
+#include "ThreadPool.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(const Clock::time_point& start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+BulkLoader::BulkLoader(ThreadPool& pool) : pool(pool), parseSeconds(0.0), convertSeconds(0.0)
+{
+}
+
+BulkLoader::BulkLoader() : BulkLoader(ThreadPool::getShared())
+{
+}
+
+bool BulkLoader::load(std::istream& stream, std::vector<ref<ArcSpline>>* result)
+{
+	// Parse all lines first
+	const Clock::time_point parseStart = Clock::now();
+	std::vector<ref<FreeformLine>> lines;
+	bool isComplete = true;
+	{
+		int numLines = 0;
+		stream >> numLines;
+		lines.reserve(numLines > 0 ? numLines : 0);
+		for (int i = 0; i < numLines; i++)
+		{
+			ref<FreeformLine> line = make_ref<FreeformLine>();
+			if (!(stream >> *line)) { isComplete = false; break; }
+			lines.push_back(std::move(line));
+		}
+	}
+	parseSeconds = secondsSince(parseStart);
+
+	convert(lines, result);
+	return isComplete;
+}
+
+void BulkLoader::load(const StrokeArchive& archive, std::vector<ref<ArcSpline>>* result)
+{
+	const Clock::time_point parseStart = Clock::now();
+	std::vector<ref<FreeformLine>> lines;
+	archive.getStrokes(&lines);
+	parseSeconds = secondsSince(parseStart);
+
+	convert(lines, result);
+}
+
+void BulkLoader::convert(const std::vector<ref<FreeformLine>>& lines, std::vector<ref<ArcSpline>>* result)
+{
+	// Convert lines concurrently; each task writes to its own slots only
+	const Clock::time_point convertStart = Clock::now();
+	const int numLines = (int)lines.size();
+	std::vector<ref<ArcSpline>> splines(numLines);
+	strokeTimings.assign(numLines, StrokeTiming());
+	std::mutex progressMutex;
+	int numConverted = 0;
+	pool.parallelFor(numLines, [&](int idx)
+	{
+		const Clock::time_point start = Clock::now();
+		lines[idx]->setMomentsKept(areMomentsKept);
+		ref<ArcSplineUtil::ProcessingInput> input = new ArcSplineUtil::ProcessingInput(processingInput);
+		SplineResult cached;
+		const bool isCached = cache && cache->find(*lines[idx], idx, isCachedInputMatched, input, &cached);
+		splines[idx] = isCached ? make_ref<ArcSpline>(lines[idx], input, cached) : make_ref<ArcSpline>(lines[idx], input);
+
+		StrokeTiming& timing = strokeTimings[idx];
+		timing.isCached = isCached;
+		timing.numPoints = std::max(0, lines[idx]->numPoints() - 2); // without sentinels
+		timing.length = lines[idx]->length();
+		timing.convertSeconds = secondsSince(start);
+
+		std::lock_guard<std::mutex> lock(progressMutex);
+		++numConverted;
+		if (onProgress) { onProgress(numConverted, numLines); }
+	});
+	convertSeconds = secondsSince(convertStart);
+
+	// Publish in stream order
+	result->insert(result->end(), std::make_move_iterator(splines.begin()), std::make_move_iterator(splines.end()));
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <functional>
+#include <iosfwd>
+#include <vector>
+
+#include "ArcSplineUtil.h"
+#include "Common.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+BulkLoader reads a list of FreeformLines from a StrokeArchive, or from text
+written with FreeformLine's stream operators, and builds an ArcSpline for each
+of them.
+
+Parsing a text stream is inherently serial, so all lines are read first. Lines
+from an archive view its mapped arrays, so reading them costs next to nothing. The
+ArcSplines are then constructed on a ThreadPool, one task per line, and written
+to their original slots, so the result is in file order regardless of which
+thread converted which line. Lines & splines count references atomically, so
+they can be referenced from any thread. Each spline gets its own copy of
+processingInput, so tweaking one spline's settings doesn't affect the others.
+
+With a SplineCache, lines with a stored result skip the conversion, and by
+default get back the settings stored with it.
+
+Progress is reported after each converted line, and the conversion time of
+every line is kept for inspection.
+
+See: ArcSpline, ThreadPool, SplineCache
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+class ArcSpline;
+class FreeformLine;
+class SplineCache;
+class StrokeArchive;
+class ThreadPool;
+
+// Loads saved FreeformLines & converts them into ArcSplines on a ThreadPool.
+class BulkLoader
+{
+public:
+	// Called with the number of converted lines & the total number of lines; may be called from any pool thread, but never concurrently
+	typedef std::function<void(int numConverted, int numLines)> ProgressCallback;
+
+	// Timing of a single line
+	struct StrokeTiming
+	{
+		// Number of input points & length of the line
+		int numPoints;
+		float length;
+
+		// Time spent constructing the ArcSpline
+		double convertSeconds;
+
+		// Was the result taken from the cache
+		bool isCached;
+	};
+
+	// Use the pool for conversion; the pool must outlive the loader
+	explicit BulkLoader(ThreadPool& pool);
+
+	// Use the shared ThreadPool
+	BulkLoader();
+
+	// Called after each converted line; optional
+	ProgressCallback onProgress;
+
+	// Algorithm parameters; each spline gets its own copy
+	ArcSplineUtil::ProcessingInput processingInput;
+
+	// Results stored for lines are taken from it instead of converting them, looked up by each line's position among the loaded ones; optional, must outlive load() & convert()
+	const SplineCache* cache = nullptr;
+
+	// Take cached results only if they were computed with processingInput, instead of taking the settings stored with them
+	bool isCachedInputMatched = false;
+
+	// Make lines keep moments, see FreeformLine::setMomentsKept(); convert() sets it on the given lines
+	bool areMomentsKept = false;
+
+	// Read lines from the text stream & append their ArcSplines to result in stream order. Returns false if the stream ended early; lines read until then are still converted.
+	bool load(std::istream& stream, std::vector<ref<ArcSpline>>* result);
+
+	// Take all lines from the archive & append their ArcSplines to result in stored order
+	void load(const StrokeArchive& archive, std::vector<ref<ArcSpline>>* result);
+
+	// Append ArcSplines of the lines to result in the same order
+	void convert(const std::vector<ref<FreeformLine>>& lines, std::vector<ref<ArcSpline>>* result);
+
+	// Timing of each line converted by the last load() or convert(), in stream order
+	const std::vector<StrokeTiming>& getStrokeTimings() const { return strokeTimings; }
+
+	// Wall-clock time of the last load() or convert(), for reading the lines & for the conversion of all lines
+	double getParseSeconds() const { return parseSeconds; }
+	double getConvertSeconds() const { return convertSeconds; }
+
+private:
+	// Pool running the conversion
+	ThreadPool& pool;
+
+	// Timings of the last load()
+	std::vector<StrokeTiming> strokeTimings;
+	double parseSeconds, convertSeconds;
+};
@@ -1,18 +1,24 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
 #include <cfloat>
 #include <cmath>
+#include <utility>
 
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 This is a set of generic constants, types, and functions, and also a couple of
 ArcSpline settings.
 
 ref & RefCounted are an intrusive smart pointer & base RefCounted
-implementation.
+implementation. RefCounted counts references with a plain int, which is cheap
+but only safe while a single thread references the object.
+ThreadSafeRefCounted counts atomically, for objects handed to other threads,
+e.g. lines & splines converted on a ThreadPool. Moving a ref doesn't touch the
+count at all.
 
 FPExceptionEnabler enables floating-point exceptions in its scope to find
-potential performance hits.
+potential performance hits. It's MSVC-only & does nothing with other compilers.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 #if _DEBUG
@@ -83,19 +89,21 @@ struct Range
 
 // An intrusive smart pointer; it implicitly casts to/from naked pointers.
 //
-// Referenced object should derive from RefCounted.
+// Referenced object should derive from RefCounted or ThreadSafeRefCounted.
 template <class T> class ref
 {
 public:
-	// Construct empty, from a naked pointer, copy, and destruct
+	// Construct empty, from a naked pointer, copy, move, and destruct
 	ref() : ptr(nullptr) { }
 	ref(T* ptr) : ptr(ptr) { if (ptr) ptr->addRef(); }
 	ref(const ref<T>& other) : ref(other.ptr) { }
+	ref(ref<T>&& other) noexcept : ptr(other.ptr) { other.ptr = nullptr; }
 	~ref() { if (ptr) ptr->removeRef(); }
 
-	// Assign from a naked or smart pointer
+	// Assign from a naked or smart pointer; moving takes over the reference of other & leaves it empty
 	const ref& operator = (T* other) { if (other) other->addRef(); if (ptr) ptr->removeRef(); ptr = other; return *this; } // Handles assignment to self
 	const ref& operator = (const ref<T>& other) { return operator = (other.ptr); }
+	const ref& operator = (ref<T>&& other) noexcept { if (this != &other) { T* old = ptr; ptr = other.ptr; other.ptr = nullptr; if (old) old->removeRef(); } return *this; }
 
 	// Treat a ref<T> like a normal pointer; implicitly cast to it & access members of pointed object
 	operator T* () const { return ptr; }
@@ -107,39 +115,73 @@ private:
 };
 
 
-// Base class for objects referenced with the ref<class T> intrusive pointer.
-class RefCounted
+// Create an object & reference it, e.g. make_ref<ArcSpline>(line)
+template <class T, class... TArgs> ref<T> make_ref(TArgs&&... args) { return ref<T>(new T(std::forward<TArgs>(args)...)); }
+
+
+// Reference count of objects used by a single thread at a time
+struct SingleThreadRefCount
+{
+	SingleThreadRefCount() : count(0) { }
+	void increment() { ++count; }
+	bool decrement() { return 0 == --count; } // Returns true when the last reference is gone
+	int get() const { return count; }
+	int count;
+};
+
+// Reference count of objects shared between threads
+struct AtomicRefCount
+{
+	AtomicRefCount() : count(0) { }
+	void increment() { count.fetch_add(1, std::memory_order_relaxed); }
+	bool decrement() { return 1 == count.fetch_sub(1, std::memory_order_acq_rel); } // Returns true when the last reference is gone; acquire makes other threads' writes visible to the destructor
+	int get() const { return count.load(std::memory_order_relaxed); }
+	std::atomic<int> count;
+};
+
+// Base class for objects referenced with the ref<class T> intrusive pointer; TRefCount is SingleThreadRefCount or AtomicRefCount.
+template <class TRefCount> class RefCountedBase
 {
 public:
 	// Grant access to addRef/removeRef for ref<class T> 
 	template <class T> friend class ref;
 
+	// Number of references; only a hint while other threads may add or drop references
+	int getRefCount() const { return refCount.get(); }
+
 protected:
-	RefCounted() : refCount(0) { }
-	virtual ~RefCounted() { ME_ASSERT(refCount == 0); }
+	RefCountedBase() { }
+	virtual ~RefCountedBase() { ME_ASSERT(refCount.get() == 0); }
 
 	// Prevent copying of refCount between objects in construction, assignment, and swapping
-	RefCounted(const RefCounted&) : RefCounted() { }
-	RefCounted& operator = (const RefCounted&) { return *this; }
-	void swap(RefCounted&) { }
+	RefCountedBase(const RefCountedBase&) : RefCountedBase() { }
+	RefCountedBase& operator = (const RefCountedBase&) { return *this; }
+	void swap(RefCountedBase&) { }
 
 private:
 	// Add reference
-	void addRef() const { ++refCount; }
+	void addRef() const { refCount.increment(); }
 
 	// Decrease reference count & delete itself if the count falls to zero.
-	void removeRef() const { if (0 == --refCount) delete this; }
+	void removeRef() const { if (refCount.decrement()) delete this; }
 
 	// Allow refCount update for const-type refs
-	mutable int refCount; 
+	mutable TRefCount refCount;
 };
 
+// Base class of objects referenced from a single thread at a time
+typedef RefCountedBase<SingleThreadRefCount> RefCounted;
+
+// Base class of objects referenced from several threads at once
+typedef RefCountedBase<AtomicRefCount> ThreadSafeRefCounted;
+
 
 // Declare an object of this type in a scope in order to enable a
 // specified set of floating-point exceptions temporarily. The old
 // exception state will be reset at the end.
 // This class can be nested.
 // From https://randomascii.wordpress.com/2012/04/21/exceptional-floating-point/
+#if defined _MSC_VER
 class FPExceptionEnabler
 {
 public:
@@ -181,4 +223,16 @@ private:
 	// and unimplemented to prohibit copying.
 	FPExceptionEnabler(const FPExceptionEnabler&);
 	FPExceptionEnabler& operator=(const FPExceptionEnabler&);
-};
\ No newline at end of file
+};
+#else
+// No-op for other compilers
+class FPExceptionEnabler
+{
+public:
+	FPExceptionEnabler(unsigned int /*enableBits*/ = 0) { }
+
+private:
+	FPExceptionEnabler(const FPExceptionEnabler&);
+	FPExceptionEnabler& operator=(const FPExceptionEnabler&);
+};
+#endif
\ No newline at end of file
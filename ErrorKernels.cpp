@@ -0,0 +1,110 @@
+#include "FreeformTool.h"
+#include "ErrorKernels.h"
+
+#include <type_traits>
+
+#include "Geometry.h"
+#include "SimdFloat.h"
+
+// Signed distance evaluators, usable with both SimdFloat & float lanes. They repeat the arithmetic of the shapes' signedDistTo().
+namespace
+{
+	struct LineDist
+	{
+		float a, b, c;
+		template <class T> T operator () (const T& x, const T& y) const { return (T(a) * x + T(b) * y) + T(c); }
+	};
+
+	struct CircleDist
+	{
+		float x, y, radius;
+		template <class T> T operator () (const T& px, const T& py) const { T dx = px - T(x); T dy = py - T(y); return simdSqrt(dx * dx + dy * dy) - T(radius); }
+	};
+
+	// Distance reported for invalid shapes, as in CircleOrLine::signedDistTo()
+	struct InvalidDist
+	{
+		template <class T> T operator () (const T&, const T&) const { return T(ME_A_LOT); }
+	};
+
+	// Picks one of the two child shape distances, as in Biarc::signedDistTo()
+	template <class TDist0, class TDist1> struct BiarcDist
+	{
+		LineDist divLine;
+		float divLineDistToPoint0, d1;
+		TDist0 dist0;
+		TDist1 dist1;
+		template <class T> T operator () (const T& x, const T& y) const
+		{
+			T sign = T(divLineDistToPoint0) * divLine(x, y);
+			sign = sign * T(d1);
+			return selectIfNonNegative(sign, dist0(x, y), dist1(x, y));
+		}
+	};
+
+	LineDist toDist(const Line& line) { return LineDist{ line.a, line.b, line.c }; }
+	CircleDist toDist(const Circle& circle) { return CircleDist{ circle.x, circle.y, circle.radius }; }
+
+	// Sum squared distances over all samples, full SIMD batches first, then the remaining samples one at a time
+	template <class TDist> float sumSquared(const LineSamples& samples, const TDist& dist)
+	{
+		const int numSamples = samples.size();
+		const int numBatched = numSamples - numSamples % SimdFloat::width;
+		const float* xs = samples.x.data();
+		const float* ys = samples.y.data();
+
+		SimdFloat sum = 0.0f;
+		for (int i = 0; i < numBatched; i += SimdFloat::width)
+		{
+			SimdFloat d = dist(SimdFloat::load(xs + i), SimdFloat::load(ys + i));
+			sum = sum + d * d;
+		}
+
+		float tailSum = 0.0f;
+		for (int i = numBatched; i < numSamples; i++)
+		{
+			float d = dist(xs[i], ys[i]);
+			tailSum += d * d;
+		}
+		return sum.sum() + tailSum;
+	}
+
+	// Call func with the distance evaluator matching the shape type
+	template <class TFunc> float withDist(const CircleOrLine& shape, const TFunc& func)
+	{
+		switch (shape.type)
+		{
+		case CircleOrLine::TYPE_CIRCLE: return func(toDist(shape.circle));
+		case CircleOrLine::TYPE_LINE: return func(toDist(shape.line));
+		default:
+			ME_ASSERT(false);
+			return func(InvalidDist());
+		}
+	}
+}
+
+float ErrorKernels::sumSquaredDist(const LineSamples& samples, const Line& line)
+{
+	return sumSquared(samples, toDist(line));
+}
+
+float ErrorKernels::sumSquaredDist(const LineSamples& samples, const Circle& circle)
+{
+	return sumSquared(samples, toDist(circle));
+}
+
+float ErrorKernels::sumSquaredDist(const LineSamples& samples, const CircleOrLine& shape)
+{
+	return withDist(shape, [&](const auto& dist) { return sumSquared(samples, dist); });
+}
+
+float ErrorKernels::sumSquaredDist(const LineSamples& samples, const Biarc& biarc)
+{
+	ME_ASSERT(0.0f <= biarc.param.d1);
+	return withDist(biarc.shape0, [&](const auto& dist0) {
+		return withDist(biarc.shape1, [&](const auto& dist1) {
+			BiarcDist<std::decay_t<decltype(dist0)>, std::decay_t<decltype(dist1)>> dist = { toDist(biarc.divLine), biarc.divLine.signedDistTo(biarc.point0), biarc.param.d1, dist0, dist1 };
+			return sumSquared(samples, dist);
+		});
+	});
+}
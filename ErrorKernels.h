@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+
+#include "Common.h"
+#include "MonotonicArena.h"
+#include "Vector2.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Error kernels measure how well a shape fits a FreeformLine section. They sum
+squared signed distances between the shape & points sampled along the line.
+
+The line is sampled once into LineSamples (x & y in separate arrays), and each
+kernel then evaluates a whole batch of points against a shape, several points
+per SIMD instruction. Shape type checks (Circle or Line, which arc of a Biarc)
+happen once per batch, or as a per-lane select, instead of once per point.
+
+Sums are accumulated per lane & added up at the end, so results match the
+scalar signedDistTo() loop within float tolerance, not bit-exactly.
+
+See: SimdFloat, ArcSplineUtil::calcMeanSquaredError
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+struct Line;
+struct Circle;
+struct CircleOrLine;
+struct Biarc;
+
+// Points sampled along a FreeformLine, stored as separate x & y arrays
+struct LineSamples
+{
+	// Store samples in the arena, or on the heap if it's null
+	explicit LineSamples(MonotonicArena* arena = nullptr) : x(arena), y(arena) { }
+
+	// Number of samples
+	int size() const { return (int)x.size(); }
+
+	// Remove all samples, keep the memory
+	void clear() { x.clear(); y.clear(); }
+
+	// Append a sample
+	void add(const Vector2& point) { x.push_back(point.x); y.push_back(point.y); }
+
+	// Sample coordinates
+	ArenaVector<float> x, y;
+};
+
+// Vectorized sums of squared signed distances between line samples & shapes.
+struct ErrorKernels
+{
+	// Sum of squared signed distances from each sample to the shape
+	static float sumSquaredDist(const LineSamples& samples, const Line& line);
+	static float sumSquaredDist(const LineSamples& samples, const Circle& circle);
+	static float sumSquaredDist(const LineSamples& samples, const CircleOrLine& shape);
+	static float sumSquaredDist(const LineSamples& samples, const Biarc& biarc);
+};
@@ -1,39 +1,276 @@
 #include "FreeformTool.h"
 #include "FreeformLine.h"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
 #include <vector>
 
 #include "Common.h"
+#include "Geometry.h"
 
 void FreeformLine::addPoint(const Vector2& point)
 {
-	if (points.size())
+	if (!pointCount)
 	{
-		const std::pair<const float, Vector2>& lastPoint = *++points.rbegin();
-		float length = lastPoint.first + lastPoint.second.distTo(point);
-		points[length] = point;
-		points.rbegin()->second = point;
-		cachedLength = length;
+		++revision;
+		makePointsOwned();
+		appendPoint(-ME_A_LOT, point);
+		appendPoint(0.0f, point);
+		appendPoint(ME_A_LOT, point);
+		decimation.lastInputPoint = point;
+		decimation.lastInputT = 0.0f;
+		decimation.hasLastInput = true;
+		updateMoments(0);
+		return;
+	}
+
+	const int lastIdx = numPoints() - 2; // skip the end sentinel
+	float length = pointTs[lastIdx] + getInputPoint(lastIdx).distTo(point);
+	bool replacesLastPoint = false;
+	if (0.0f < decimationTolerance && decimation.hasLastInput)
+	{
+		// Measure 't' along all input points, stored or not
+		length = decimation.lastInputT + decimation.lastInputPoint.distTo(point);
+	}
+	decimation.lastInputPoint = point;
+	decimation.lastInputT = length;
+	decimation.hasLastInput = true;
+	if (0.0f < decimationTolerance)
+	{
+		// Drop points close to the last one, but keep them within tolerance if the last one is replaced later. Replace the last one if the sleeve allows.
+		if (getInputPoint(lastIdx).distTo(point) <= decimationTolerance)
+		{
+			if (!narrowSleeve(point)) { decimation.isSleeveOpen = false; }
+			return;
+		}
+		replacesLastPoint = canReplaceLastPoint(point);
+	}
+
+	++revision;
+	makePointsOwned();
+	const int numKeptPoints = replacesLastPoint ? lastIdx : lastIdx + 1;
+	ownedTs.resize(numKeptPoints); ownedXs.resize(numKeptPoints); ownedYs.resize(numKeptPoints);
+	updatePointViews();
+	appendPoint(length, point);
+	appendPoint(ME_A_LOT, point);
+	updateMoments(numKeptPoints);
+	cachedLength = length;
+	if (0.0f < decimationTolerance && !replacesLastPoint) { openSleeve(); }
+}
+
+void FreeformLine::appendPoint(float t, const Vector2& point)
+{
+	ME_ASSERT(!hasExternalPoints());
+	ME_ASSERT(ownedTs.empty() || ownedTs.back() <= t);
+	if (ownedTs.size() && ownedTs.back() == t)
+	{
+		ownedXs.back() = point.x;
+		ownedYs.back() = point.y;
 	}
 	else
 	{
-		points[ME_A_LOT] = points[0.0f] = points[-ME_A_LOT] = point;
+		ownedTs.push_back(t);
+		ownedXs.push_back(point.x);
+		ownedYs.push_back(point.y);
+		updatePointViews();
+	}
+}
+
+void FreeformLine::setMomentsKept(bool isKept)
+{
+	if (isKept == isMomentsKept) { return; }
+	++revision; // segments found for the line change
+	isMomentsKept = isKept;
+	if (isKept) { updateMoments(0); }
+	else { prefixMoments.clear(); prefixMoments.shrink_to_fit(); }
+}
+
+FreeformLine::Moments FreeformLine::getMoments(float tStart, float tEnd) const
+{
+	ME_ASSERT(isMomentsKept && pointCount >= 3);
+	ME_ASSERT(0.0f <= tStart && tStart <= tEnd && tEnd <= length());
+	double start[numMoments], end[numMoments];
+	integrateTo(findSegment(tStart), tStart, start);
+	integrateTo(findSegment(tEnd), tEnd, end);
+
+	Moments result;
+	result.length = double(tEnd) - double(tStart);
+	result.x = end[0] - start[0];
+	result.y = end[1] - start[1];
+	result.xx = end[2] - start[2];
+	result.xy = end[3] - start[3];
+	result.yy = end[4] - start[4];
+	result.origin = getInputPoint(1);
+	return result;
+}
+
+// Add the integrals of x, y, xx, xy & yy over a straight piece from a to b, of length dt
+static void addSegmentMoments(double ax, double ay, double bx, double by, double dt, double* result)
+{
+	result[0] += dt * (ax + bx) / 2.0;
+	result[1] += dt * (ay + by) / 2.0;
+	result[2] += dt * (ax * ax + ax * bx + bx * bx) / 3.0;
+	result[3] += dt * (2.0 * ax * ay + ax * by + bx * ay + 2.0 * bx * by) / 6.0;
+	result[4] += dt * (ay * ay + ay * by + by * by) / 3.0;
+}
+
+void FreeformLine::updateMoments(int firstIdx)
+{
+	if (!isMomentsKept) { return; }
+	prefixMoments.resize(numMoments * size_t(pointCount));
+	if (pointCount < 3) { return; }
+
+	// Nothing is integrated before the first point; the end sentinel repeats the last point
+	for (int i = firstIdx; i <= 1; i++) { std::fill_n(&prefixMoments[numMoments * i], numMoments, 0.0); }
+	const double ox = pointXs[1], oy = pointYs[1];
+	const int lastIdx = pointCount - 2;
+	for (int i = std::max(firstIdx, 2); i <= lastIdx; i++)
+	{
+		double* entry = &prefixMoments[numMoments * i];
+		std::copy_n(entry - numMoments, numMoments, entry);
+		addSegmentMoments(pointXs[i - 1] - ox, pointYs[i - 1] - oy, pointXs[i] - ox, pointYs[i] - oy, double(pointTs[i]) - double(pointTs[i - 1]), entry);
 	}
+	std::copy_n(&prefixMoments[numMoments * lastIdx], numMoments, &prefixMoments[numMoments * (lastIdx + 1)]);
+}
+
+void FreeformLine::integrateTo(int idx, float t, double* result) const
+{
+	std::copy_n(&prefixMoments[numMoments * idx], numMoments, result);
+	if (t <= pointTs[idx]) { return; }
+	const Vector2 origin = getInputPoint(1);
+	const Vector2 a = getInputPoint(idx) - origin;
+	const Vector2 b = interpolateSegment(idx, t) - origin;
+	addSegmentMoments(a.x, a.y, b.x, b.y, double(t) - double(pointTs[idx]), result);
 }
 
-void FreeformLine::setBounds(const Range& range)
+float FreeformLine::Moments::sumSquaredDist(const Line& line) const
 {
-	clippingRange = range;
-	clippingMargin = std::fmin(2.0f * halfSmoothingSpread, range.length());
+	// Expand the integral of (a x + b y + c)² with c moved to origin
+	const double a = line.a, b = line.b, c = line.c + a * origin.x + b * origin.y;
+	const double sum = a * a * xx + 2.0 * a * b * xy + b * b * yy + 2.0 * c * (a * x + b * y) + c * c * length;
+	return float(std::max(sum, 0.0));
+}
+
+Line FreeformLine::Moments::bestFitLine() const
+{
+	if (!(0.0 < length)) { return Line::fromPointAndNormal(origin, Vector2::unitY); }
+
+	// The line passes through the centroid, along the principal axis of the covariance
+	const double mx = x / length, my = y / length;
+	const double cxx = xx / length - mx * mx, cxy = xy / length - mx * my, cyy = yy / length - my * my;
+	const double angle = 0.5 * std::atan2(2.0 * cxy, cxx - cyy);
+	const Vector2 normal(float(-std::sin(angle)), float(std::cos(angle)));
+	return Line::fromPointAndNormal(origin + Vector2(float(mx), float(my)), normal);
+}
+
+void FreeformLine::openSleeve()
+{
+	// The anchor is the point before the last one; there's none right after the first point
+	decimation.isSleeveOpen = false;
+	const int lastIdx = numPoints() - 2;
+	if (lastIdx < 2) { return; }
+	const Vector2 offset = getInputPoint(lastIdx) - getInputPoint(lastIdx - 1);
+	const float dist = offset.norm();
+	if (!(decimationTolerance < dist && dist <= halfSmoothingSpread)) { return; }
+
+	const float halfAngle = std::asin(decimationTolerance / dist);
+	decimation.direction = offset / dist;
+	decimation.minAngle = -halfAngle;
+	decimation.maxAngle = halfAngle;
+	decimation.lastDist = dist;
+	decimation.isSleeveOpen = true;
+}
+
+bool FreeformLine::narrowSleeve(const Vector2& point)
+{
+	if (!decimation.isSleeveOpen) { return false; }
+
+	// Points within tolerance of the anchor are close to all directions
+	const Vector2 offset = point - getInputPoint(numPoints() - 3);
+	const float dist = offset.norm();
+	if (dist <= decimationTolerance) { return true; }
+	const float angle = std::atan2(decimation.direction.cross(offset), decimation.direction.dot(offset));
+	if (angle < decimation.minAngle || decimation.maxAngle < angle) { return false; }
+
+	const float halfAngle = std::asin(decimationTolerance / dist);
+	decimation.minAngle = std::fmax(decimation.minAngle, angle - halfAngle);
+	decimation.maxAngle = std::fmin(decimation.maxAngle, angle + halfAngle);
+	return true;
+}
+
+bool FreeformLine::canReplaceLastPoint(const Vector2& point)
+{
+	// The point must be farther from the anchor than the last one, within halfSmoothingSpread, and in the sleeve
+	if (!decimation.isSleeveOpen) { return false; }
+	const float dist = point.distTo(getInputPoint(numPoints() - 3));
+	if (dist < decimation.lastDist || halfSmoothingSpread < dist || !narrowSleeve(point)) { return false; }
+	decimation.lastDist = dist;
+	return true;
+}
+
+void FreeformLine::makePointsOwned()
+{
+	if (!hasExternalPoints()) { return; }
+	ownedTs.assign(pointTs, pointTs + pointCount);
+	ownedXs.assign(pointXs, pointXs + pointCount);
+	ownedYs.assign(pointYs, pointYs + pointCount);
+	externalPointsOwner = nullptr;
+	updatePointViews();
+}
+
+void FreeformLine::clearPoints()
+{
+	ownedTs.clear(); ownedXs.clear(); ownedYs.clear();
+	prefixMoments.clear();
+	externalPointsOwner = nullptr;
+	decimation.hasLastInput = false;
+	decimation.isSleeveOpen = false;
+	updatePointViews();
+}
+
+void FreeformLine::setExternalPoints(const std::shared_ptr<const void>& owner, const float* ts, const float* xs, const float* ys, int numPoints)
+{
+	ME_ASSERT(owner && (numPoints == 0 || numPoints >= 3));
+	clearPoints();
+	externalPointsOwner = owner;
+	pointTs = ts; pointXs = xs; pointYs = ys;
+	pointCount = numPoints;
+	cachedLength = numPoints >= 2 ? pointTs[numPoints - 2] : 0.0f;
+	updateMoments(0);
+	++revision;
+}
+
+FreeformLine& FreeformLine::operator=(const FreeformLine& other)
+{
+	if (this == &other) { return *this; }
+	halfSmoothingSpread = other.halfSmoothingSpread;
+	tangentFieldResolution = other.tangentFieldResolution;
+	decimationTolerance = other.decimationTolerance;
+	ownedTs = other.ownedTs; ownedXs = other.ownedXs; ownedYs = other.ownedYs;
+	externalPointsOwner = other.externalPointsOwner;
+	if (hasExternalPoints())
+	{
+		pointTs = other.pointTs; pointXs = other.pointXs; pointYs = other.pointYs;
+		pointCount = other.pointCount;
+	}
+	else
+	{
+		updatePointViews();
+	}
+	isMomentsKept = other.isMomentsKept;
+	prefixMoments = other.prefixMoments;
+	decimation = other.decimation;
+	cachedLength = other.cachedLength;
+	revision = other.revision;
+	return *this;
 }
 
 std::ostream& operator<<(std::ostream& stream, const FreeformLine& line)
 {
 	stream << line.halfSmoothingSpread << " ";
-	stream << (int)line.points.size() << " ";
-	for (const auto& pt : line.points) { stream << pt.first << " " << pt.second.x << " " << pt.second.y << " "; }
+	stream << line.numPoints() << " ";
+	for (int i = 0; i < line.numPoints(); i++) { stream << line.pointTs[i] << " " << line.pointXs[i] << " " << line.pointYs[i] << " "; }
 	return stream;
 }
 
@@ -43,14 +280,19 @@ std::istream& operator>>(std::istream& stream, FreeformLine& line)
 	float t;
 	Vector2 v;
 
-	line.points.clear();
+	line.clearPoints();
+	++line.revision;
 	stream >> line.halfSmoothingSpread;
 	stream >> numPoints;
+	line.ownedTs.reserve(numPoints);
+	line.ownedXs.reserve(numPoints);
+	line.ownedYs.reserve(numPoints);
 	for (int i = 0; i < numPoints; i++)
 	{
 		stream >> t >> v.x >> v.y;
-		line.points[t] = v;
+		line.appendPoint(t, v); // saved lines are already sorted
 	}
-	line.cachedLength = line.points.size() ? (++line.points.rbegin())->first : 0.0f;
+	line.cachedLength = line.numPoints() >= 2 ? line.pointTs[line.numPoints() - 2] : 0.0f;
+	line.updateMoments(0);
 	return stream;
 }
@@ -1,56 +1,143 @@
 #pragma once
 
+#include <iosfwd>
+#include <memory>
 #include <vector>
-#include <map>
 
+#include "Instrumentation.h"
 #include "Vector2.h"
 
+struct Line;
+
 /* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
-FreeformLine collects points, puts them in a map & assigns each point with
-'distance traveled' from the beginning of the line. You can search a point
-on the line by it's 't' (distance from beginning) param in. That should be 
-in log(length) time, given the map is implemented as a balanced tree.
+FreeformLine collects points, puts them in sorted contiguous arrays & assigns
+each point with 'distance traveled' from the beginning of the line. You can
+search a point on the line by it's 't' (distance from beginning) param in.
+That's a branch-free binary search over the array of t values, in log(length)
+time. Point coordinates are kept in separate x & y arrays (SoA), so a lookup
+only touches the t array plus the two neighbouring points. Loops that query
+the line at increasing 't' should use a Cursor, which continues from the
+previous result instead of searching from scratch.
 
 Querying local tangent is very noisy given our line is from a mouse input and
-point-to-point distance often is just a pixel or a few. getTangentAt() returns
-smoothed tangent querying points halfSmoothingSpread away on either side.  When
-setTangentBounds() is used those those points are clipped to within a range. 
-This is a trick to freeze line's measured tangent when close to clipping bounds.
-
-You can serialize a FreeformLine to a text file with the stream operators.
+point-to-point distance often is just a pixel or a few. Smoothed tangents are
+queried through a FreeformLineSection, which samples points halfSmoothingSpread
+away on either side & clips them to within a range. The line itself holds no
+processing state, so one line can be processed by many readers at once.
+
+High-rate input devices send many nearly collinear & sub-pixel points. With a
+decimationTolerance, addPoint() drops points within that distance of the last
+one, and replaces the last point while all points it stands for stay within
+the tolerance of the straight line from the point before. That's checked in
+constant time with a sleeve of directions, narrowed by each replaced point.
+Stored points keep the 't' of their input point, the arc length over all input
+points, and are at most halfSmoothingSpread apart. So smoothed tangents &
+corners see about the same turns at the same 't' as with all points.
+
+Checking how well a straight line fits a section doesn't have to sample it.
+With setMomentsKept(), the line keeps prefix sums of x, y, x², xy & y²,
+integrated along 't' over the stored polyline, in doubles & relative to the
+first point. getMoments() then finds the moments of any section from two table
+entries & the partial segments at its ends, so the squared distance to any Line
+or the best-fitting Line of a section cost the same regardless of its length.
+The tables are updated as points are added, in constant time per point.
+
+You can serialize a FreeformLine to a text file with the stream operators, or
+store many lines in a binary StrokeArchive. Lines read from an archive view the
+mapped file's arrays directly, and copy them only when points are added.
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 // Converts a series of input points in to a parametrized line.
 //
-// Also queries smoothed tangent along the line & lets you restrict tangent
-// calculation to a Range, which helps when working with a section of a line
-// only.
-class FreeformLine : public RefCounted
+// Smoothing settings are kept here; smoothed tangents are queried through a
+// FreeformLineSection.
+class FreeformLine : public ThreadSafeRefCounted
 {
 public:
-	FreeformLine() : halfSmoothingSpread(10.0f), cachedLength(0.0f), clippingRange({-ME_A_LOT, ME_A_LOT}), clippingMargin(0.0f)  { }
+	FreeformLine() : halfSmoothingSpread(10.0f), tangentFieldResolution(1.0f), decimationTolerance(0.0f), pointTs(nullptr), pointXs(nullptr), pointYs(nullptr), pointCount(0), isMomentsKept(false), decimation(), cachedLength(0.0f), revision(0) { }
+
+	// Copy points & settings. Points stored externally stay shared.
+	FreeformLine(const FreeformLine& other) : FreeformLine() { *this = other; }
+	FreeformLine& operator = (const FreeformLine& other);
 
-	// Append a point to the line, grow it's length.
+	// Append a point to the line, grow it's length. With decimationTolerance, the point may replace the last one, or be dropped.
 	void addPoint(const Vector2& point);
-	
+
 	// Return total length of this line
 	float length() const { return cachedLength;  } 
 
+	// Incremented whenever points change; lets users of the line detect changes
+	unsigned int getRevision() const { return revision; }
+
 	// Calculate the point on the line at 't' distance from it's start.
 	inline Vector2 getPointAt(float t) const;
 
-	// Calculate approximate smoothed tangent at 't' distance from the line's start; 't' is clipped to within getBounds()
-	inline Vector2 getTangentAt(float t) const;
+	// Number of stored points, including the two sentinel points at -ME_A_LOT & ME_A_LOT
+	int numPoints() const { return pointCount; }
+
+	// Replace points with arrays stored elsewhere, e.g. in a mapped StrokeArchive, without copying. Arrays hold numPoints values incl. sentinels & stay valid while owner is alive.
+	void setExternalPoints(const std::shared_ptr<const void>& owner, const float* ts, const float* xs, const float* ys, int numPoints);
 
-	// Get clipping bounds used for tangent calculation
-	const Range& getBounds() const { return clippingRange; }
+	// Are points stored outside of this line
+	bool hasExternalPoints() const { return externalPointsOwner != nullptr; }
 
-	// Set clipping bounds for tangent calculation
-	void setBounds(const Range& range);
+	// Stored input point; idx is in [0, numPoints()), where 0 & numPoints() - 1 are the sentinels
+	Vector2 getInputPoint(int idx) const { return Vector2(pointXs[idx], pointYs[idx]); }
 
 	// Determines distance between points used to query the tangent at a point. Must be greater than epsilon.
 	float halfSmoothingSpread; 
 
+	// Distance between tangent samples of the tangent field. Must be greater than epsilon.
+	float tangentFieldResolution;
+
+	// Max distance of dropped input points from the stored line; 0 stores all points
+	float decimationTolerance;
+
+	// Integrals of a line section along 't': its length & moments of the points, relative to origin
+	struct Moments
+	{
+		double length;
+		double x, y, xx, xy, yy;
+		Vector2 origin;
+
+		// Integral of the squared distance to the line over the section
+		float sumSquaredDist(const Line& line) const;
+
+		// Mean squared distance to the line over the section
+		float meanSquaredDist(const Line& line) const { return sumSquaredDist(line) / float(length + DBL_MIN); }
+
+		// Line with the least sumSquaredDist(); any line through origin for empty sections
+		Line bestFitLine() const;
+	};
+
+	// Keep prefix sums of moments, so getMoments() costs constant time besides locating 't'. Takes 40 bytes per point; changes the segments found by ArcSplineUtil::isSegment().
+	void setMomentsKept(bool isKept);
+	bool areMomentsKept() const { return isMomentsKept; }
+
+	// Moments of the section within [tStart, tEnd], which must be within [0, length()]; needs areMomentsKept()
+	Moments getMoments(float tStart, float tEnd) const;
+
+	// Samples the line at non-decreasing 't' in amortized constant time.
+	//
+	// Remembers the segments found by the previous query & walks forward from
+	// there. Jumping backwards falls back to the binary search. Results are
+	// identical to the FreeformLine queries; the line must outlive the Cursor.
+	class Cursor
+	{
+	public:
+		explicit Cursor(const FreeformLine& line) : line(line), pointIdx(0) { }
+
+		// Calculate the point on the line at 't' distance from it's start.
+		inline Vector2 getPointAt(float t);
+
+	private:
+		// Line being sampled
+		const FreeformLine& line;
+
+		// Segment found by the last getPointAt query
+		int pointIdx;
+	};
+
 	// Serialize & deserialize the FreeformLine
 	friend std::ostream& operator << (std::ostream& stream, const FreeformLine& line);
 	friend std::istream& operator >> (std::istream& stream, FreeformLine& line);
@@ -58,18 +145,94 @@ public:
 	// Allow drawing using original input points
 	friend class ShapeDrawer;
 
+	// Allow storing raw point arrays
+	friend class StrokeArchive;
+
+	// Allow hashing raw point arrays
+	friend class SplineCache;
+
 protected:
-	// Maps distance along the line (t) to the corresponding line input point
-	std::map<float, Vector2> points; 
+	// Find index of the last stored point at or before 't'; the result is clipped to leave room for the following point.
+	// The search starts at firstIdx, which must not be past 't'.
+	inline int findSegment(float t, int firstIdx = 0) const;
+
+	// Find the same index as findSegment(), walking forward from a previous result in amortized constant time
+	inline int findSegmentFrom(float t, int prevIdx) const;
+
+	// Interpolate between the stored point at idx & the one following it
+	inline Vector2 interpolateSegment(int idx, float t) const;
+
+	// Store a point at 't', replacing the last point if it's at the same 't'. Expects 't' not to decrease & points to be owned.
+	void appendPoint(float t, const Vector2& point);
+
+	// Copy external points into the owned arrays, so they can be modified
+	void makePointsOwned();
+
+	// Drop all points & external storage
+	void clearPoints();
+
+	// Recompute prefix moments from the entry of the point at firstIdx on, if they're kept
+	void updateMoments(int firstIdx);
+
+	// Integral from the first point to 't' within the segment at idx, which is clipped to the stored line
+	void integrateTo(int idx, float t, double* result) const;
+
+	// Start a sleeve from the point before the last one, after a point was stored
+	void openSleeve();
+
+	// Narrow the sleeve to the directions passing within tolerance of the point; false if it's closed or misses the point
+	bool narrowSleeve(const Vector2& point);
+
+	// Check if the point can replace the last one, narrowing the sleeve to it
+	bool canReplaceLastPoint(const Vector2& point);
+
+	// Point the point arrays at the owned arrays
+	void updatePointViews() { pointTs = ownedTs.data(); pointXs = ownedXs.data(); pointYs = ownedYs.data(); pointCount = (int)ownedTs.size(); }
+
+	// Distance along the line (t) of each input point, sorted ascending. Includes sentinels at -ME_A_LOT & ME_A_LOT.
+	const float* pointTs;
+
+	// Input point coordinates, indexed as pointTs
+	const float* pointXs, *pointYs;
+
+	// Size of the point arrays
+	int pointCount;
+
+	// Point arrays, unless they're external
+	std::vector<float> ownedTs, ownedXs, ownedYs;
+
+	// Keeps external point arrays alive; null when points are owned. Lines may be copied on pool threads, hence the atomic shared_ptr instead of ref.
+	std::shared_ptr<const void> externalPointsOwner;
+
+	// Prefix sums of x, y, xx, xy & yy relative to the first point, integrated up to each point; empty unless isMomentsKept
+	std::vector<double> prefixMoments;
+	static const int numMoments = 5;
+	bool isMomentsKept;
+
+	// Input tracking of decimation; see decimationTolerance
+	struct Decimation
+	{
+		// Last input point & its 't', whether it was stored or not; invalid until addPoint() is called
+		Vector2 lastInputPoint;
+		float lastInputT;
+		bool hasLastInput;
+
+		// Sleeve of directions from the point before the last one, along which the last point may be replaced. Angles are measured from direction.
+		Vector2 direction;
+		float minAngle, maxAngle;
+
+		// Distance of the last point from the one before; closer points are stored, so the line doesn't double back
+		float lastDist;
+
+		// Can the last point be replaced
+		bool isSleeveOpen;
+	} decimation;
 
 	// FreeformLine's length
 	float cachedLength;
 
-	// This is temp processing state and is not serialized.
-	//
-	// Restricts tangent calculations to data withing a range. This allows computing tangents on sub-section of line between two 'corners' or tangent-discontinuity points.
-	Range clippingRange; 
-	float clippingMargin;
+	// Point modification counter
+	unsigned int revision;
 };
 
 #include "FreeformLine.inl"
@@ -1,22 +1,51 @@
 #pragma once
 
+int FreeformLine::findSegment(float t, int firstIdx /*= 0*/) const
+{
+	ME_ASSERT(pointCount >= 2);
+	ME_ASSERT(0 <= firstIdx && firstIdx < numPoints() && pointTs[firstIdx] <= t);
+	// Branch-free binary search for the last t-value not greater than 't'; the first entry is the -ME_A_LOT sentinel.
+	const float* base = pointTs + firstIdx;
+	for (size_t count = pointCount - firstIdx; count > 1; )
+	{
+		size_t half = count / 2;
+		base = (base[half] <= t) ? base + half : base;
+		count -= half;
+	}
+	int idx = int(base - pointTs);
+	return idx < numPoints() - 2 ? idx : numPoints() - 2;
+}
+
+int FreeformLine::findSegmentFrom(float t, int prevIdx) const
+{
+	ME_ASSERT(0 <= prevIdx && prevIdx <= numPoints() - 2);
+	if (t < pointTs[prevIdx]) { return findSegment(t); } // moved backwards
+
+	// Walk a few segments forward, then fall back to searching the rest of the line
+	const int lastIdx = numPoints() - 2;
+	for (int i = 0; i < 8; ++i, ++prevIdx)
+	{
+		if (prevIdx == lastIdx || t < pointTs[prevIdx + 1]) { return prevIdx; }
+	}
+	return findSegment(t, prevIdx);
+}
+
+Vector2 FreeformLine::interpolateSegment(int idx, float t) const
+{
+	ME_COUNT(COUNTER_GET_POINT_AT);
+	const float prevT = pointTs[idx];
+	const float nextT = pointTs[idx + 1];
+	float localT = (t - prevT) / (nextT - prevT);
+	return Vector2::interpolate(getInputPoint(idx), getInputPoint(idx + 1), localT);
+}
+
 Vector2 FreeformLine::getPointAt(float t) const
 {
-	ME_ASSERT(points.size());
-	auto it = points.upper_bound(t);
-	const std::pair<const float, Vector2>& next = *it;
-	const std::pair<const float, Vector2>& prev = *--it;
-	float localT = (t - prev.first) / (next.first - prev.first);
-	return Vector2::interpolate(prev.second, next.second, localT);
+	return interpolateSegment(findSegment(t), t);
 }
 
-Vector2 FreeformLine::getTangentAt(float t) const
+Vector2 FreeformLine::Cursor::getPointAt(float t)
 {
-	ME_ASSERT(ME_EPSILON < halfSmoothingSpread);
-	// The clip is not necessary in general. Here, it will freeze the tangent at 2.0f * halfSmoothingSpread before either end.
-	float ta = getClipped(t - halfSmoothingSpread, clippingRange.start, clippingRange.end - clippingMargin);
-	float tb = getClipped(t + halfSmoothingSpread, clippingRange.start + clippingMargin, clippingRange.end);
-	Vector2 a = getPointAt(ta);
-	Vector2 b = getPointAt(tb);
-	return (b - a).normalized();
+	pointIdx = line.findSegmentFrom(t, pointIdx);
+	return line.interpolateSegment(pointIdx, t);
 }
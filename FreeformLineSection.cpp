@@ -0,0 +1,14 @@
+#include "FreeformTool.h"
+#include "FreeformLineSection.h"
+
+#include <cmath>
+
+FreeformLineSection::FreeformLineSection(const FreeformLine& line, const Range& range, bool buildTangentField /*= true*/, MonotonicArena* arena /*= nullptr*/) :
+	line(line),
+	clippingRange(range),
+	clippingMargin(std::fmin(2.0f * line.halfSmoothingSpread, range.length())),
+	tangentField(arena),
+	arena(arena)
+{
+	if (buildTangentField) { tangentField.build(*this, line.tangentFieldResolution); }
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "Common.h"
+#include "FreeformLine.h"
+#include "TangentField.h"
+#include "Vector2.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+FreeformLineSection is a lightweight, read-only view of a FreeformLine, which
+restricts tangent calculation to a Range. Sampling points of a tangent are
+clipped to within the range, which freezes the measured tangent close to its
+ends, e.g. at the 'corners' or tangent-discontinuity points of the line.
+The clipping state lives in the view instead of the line, so any number of
+sections of a single shared line can be processed at the same time, e.g. on
+different threads.
+
+Point queries are forwarded to the line. The section also samples its own
+TangentField.
+
+See: FreeformLine, TangentField
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Read-only view of a FreeformLine with tangent calculation restricted to a Range.
+class FreeformLineSection
+{
+public:
+	// View the line with clipping bounds set to range; optionally sample the tangent field, into the arena if given. The line must outlive the section.
+	FreeformLineSection(const FreeformLine& line, const Range& range, bool buildTangentField = true, MonotonicArena* arena = nullptr);
+
+	// Viewed line
+	const FreeformLine& getLine() const { return line; }
+
+	// Return total length of the viewed line
+	float length() const { return line.length(); }
+
+	// Clipping bounds for tangent calculation
+	const Range& getBounds() const { return clippingRange; }
+
+	// Calculate the point on the line at 't' distance from it's start.
+	Vector2 getPointAt(float t) const { return line.getPointAt(t); }
+
+	// Calculate approximate smoothed tangent at 't' distance from the line's start; 't' is clipped to within getBounds()
+	Vector2 getTangentAt(float t) const { ME_COUNT(COUNTER_GET_TANGENT_AT); float ta, tb; getTangentSamplingPoints(t, &ta, &tb); return (line.getPointAt(tb) - line.getPointAt(ta)).normalized(); }
+
+	// Tangents sampled within getBounds(); valid if requested at construction
+	const TangentField& getTangentField() const { return tangentField; }
+
+	// Arena for scratch data of code processing the section, e.g. the tangent field; null for the heap
+	MonotonicArena* getArena() const { return arena; }
+
+	// Calculate the clipped 't' values of the two points sampled for the tangent at 't'
+	inline void getTangentSamplingPoints(float t, float* outTa, float* outTb) const;
+
+	// Range of 't' where getTangentAt() varies; tangents are frozen outside of it
+	Range getTangentVaryingRange() const { return Range(clippingRange.start + clippingMargin - line.halfSmoothingSpread, clippingRange.end - clippingMargin + line.halfSmoothingSpread); }
+
+	// Samples the section at non-decreasing 't' in amortized constant time; see FreeformLine::Cursor
+	class Cursor
+	{
+	public:
+		explicit Cursor(const FreeformLineSection& section) : section(section), points(section.line), tangentPoints{ FreeformLine::Cursor(section.line), FreeformLine::Cursor(section.line) } { }
+
+		// Calculate the point on the line at 't' distance from it's start.
+		Vector2 getPointAt(float t) { return points.getPointAt(t); }
+
+		// Calculate approximate smoothed tangent at 't' distance from the line's start; 't' is clipped to within getBounds()
+		Vector2 getTangentAt(float t) { ME_COUNT(COUNTER_GET_TANGENT_AT); float ta, tb; section.getTangentSamplingPoints(t, &ta, &tb); Vector2 a = tangentPoints[0].getPointAt(ta); return (tangentPoints[1].getPointAt(tb) - a).normalized(); }
+
+	private:
+		// Section being sampled
+		const FreeformLineSection& section;
+
+		// Line cursors for point queries, and for the trailing & leading tangent sampling points
+		FreeformLine::Cursor points, tangentPoints[2];
+	};
+
+private:
+	// Viewed line
+	const FreeformLine& line;
+
+	// Restricts tangent calculations to data within a range
+	Range clippingRange;
+	float clippingMargin;
+
+	// Tangents sampled within clippingRange
+	TangentField tangentField;
+
+	// Arena given at construction
+	MonotonicArena* arena;
+};
+
+
+void FreeformLineSection::getTangentSamplingPoints(float t, float* outTa, float* outTb) const
+{
+	ME_ASSERT(ME_EPSILON < line.halfSmoothingSpread);
+	// The clip is not necessary in general. Here, it will freeze the tangent at 2.0f * halfSmoothingSpread before either end.
+	*outTa = getClipped(t - line.halfSmoothingSpread, clippingRange.start, clippingRange.end - clippingMargin);
+	*outTb = getClipped(t + line.halfSmoothingSpread, clippingRange.start + clippingMargin, clippingRange.end);
+}
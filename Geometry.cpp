@@ -66,7 +66,7 @@ void Biarc::findPossibleBiarcParams(const Biarc& biarcPointsAndTangents, float r
 	const Vector2 v = biarcPointsAndTangents.point1 - biarcPointsAndTangents.point0;
 
 	ME_ASSERT(result->empty());
-	float rIterationMultiplier = numResults > 1 ? std::powf(rUpper / rLower, 1.0f / (numResults - 1 + ME_EPSILON)) : 1.0f;
+	float rIterationMultiplier = numResults > 1 ? std::pow(rUpper / rLower, 1.0f / (numResults - 1 + ME_EPSILON)) : 1.0f;
 	float r = numResults > 1 ? rLower : 1.0f; // biarc length ratio parameter, if querying for one result only then override r = 1.0f
 	for (int i = 0; i < numResults; ++i, r *= rIterationMultiplier)
 	{
@@ -0,0 +1,18 @@
+#include "FreeformTool.h"
+#include "InputQueue.h"
+
+#include <chrono>
+
+InputQueue::InputQueue(int capacity) : head(0), tail(0), numDropped(0), maxOccupancy(0)
+{
+	ME_ASSERT(0 < capacity);
+	size_t size = 1;
+	while (size < (size_t)capacity) { size *= 2; }
+	items.resize(size);
+	mask = size - 1;
+}
+
+double InputQueue::getTime()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "Common.h"
+#include "Vector2.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+InputQueue passes timestamped input points from the thread capturing them to
+the thread processing them. It's a single-producer / single-consumer ring
+buffer of fixed capacity: each side only writes its own index, so push() &
+pop() are a few loads & stores without locks, and neither side ever waits for
+the other.
+
+When the consumer falls behind & the ring is full, push() drops the point
+instead of waiting. Dropped points, and the most points that were waiting at
+once, are counted, so backpressure shows up in the stats before it shows up as
+lost input.
+
+See: StrokeProcessor
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Input point & the time it was captured
+struct InputPoint
+{
+	Vector2 point;
+
+	// Seconds on the clock of InputQueue::getTime()
+	double time;
+};
+
+// Lock-free single-producer / single-consumer ring buffer of InputPoints.
+class InputQueue
+{
+public:
+	// Backpressure statistics
+	struct Stats
+	{
+		// Points queued, and points dropped because the queue was full
+		uint64_t numPushed, numDropped;
+
+		// Most points waiting in the queue at once
+		int maxOccupancy;
+	};
+
+	// Create an empty queue; capacity is rounded up to a power of two
+	explicit InputQueue(int capacity = 4096);
+
+	// Queue a point; returns false & drops it if the queue is full. Producer thread only.
+	inline bool push(const InputPoint& inputPoint);
+
+	// Take the oldest point; returns false if the queue is empty. Consumer thread only.
+	inline bool pop(InputPoint* outInputPoint);
+
+	// Is the queue empty; exact on the consumer thread, a snapshot elsewhere
+	bool isEmpty() const { return head.load(std::memory_order_relaxed) == tail.load(std::memory_order_acquire); }
+
+	// Number of points the queue holds
+	int getCapacity() const { return (int)items.size(); }
+
+	// Statistics so far; callable from any thread
+	Stats getStats() const { return Stats{ tail.load(std::memory_order_relaxed), numDropped.load(std::memory_order_relaxed), maxOccupancy.load(std::memory_order_relaxed) }; }
+
+	// Seconds on a steady clock, for timestamping points
+	static double getTime();
+
+private:
+	InputQueue(const InputQueue&) = delete;
+	InputQueue& operator = (const InputQueue&) = delete;
+
+	// Ring of points; indices are wrapped with mask
+	std::vector<InputPoint> items;
+	uint64_t mask;
+
+	// Count of points popped; written by the consumer. Padding keeps data written by different threads on separate cache lines.
+	char headPadding[64];
+	std::atomic<uint64_t> head;
+
+	// Count of points pushed; written by the producer, along with the stats
+	char tailPadding[64];
+	std::atomic<uint64_t> tail;
+	std::atomic<uint64_t> numDropped;
+	std::atomic<int> maxOccupancy;
+	char endPadding[64];
+};
+
+
+bool InputQueue::push(const InputPoint& inputPoint)
+{
+	const uint64_t t = tail.load(std::memory_order_relaxed);
+	const uint64_t occupancy = t - head.load(std::memory_order_acquire);
+	if (occupancy == items.size())
+	{
+		numDropped.store(numDropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		return false;
+	}
+	items[t & mask] = inputPoint;
+	tail.store(t + 1, std::memory_order_release);
+	if (maxOccupancy.load(std::memory_order_relaxed) <= (int)occupancy) { maxOccupancy.store((int)occupancy + 1, std::memory_order_relaxed); }
+	return true;
+}
+
+bool InputQueue::pop(InputPoint* outInputPoint)
+{
+	const uint64_t h = head.load(std::memory_order_relaxed);
+	if (h == tail.load(std::memory_order_acquire)) { return false; }
+	*outInputPoint = items[h & mask];
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
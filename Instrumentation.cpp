@@ -0,0 +1,120 @@
+#include "FreeformTool.h"
+#include "Instrumentation.h"
+
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+thread_local SplineStats* Instrumentation::currentStats = nullptr;
+
+// A finished stage, for the trace
+struct TraceEvent
+{
+	SplineStats::Stage stage;
+	int threadIdx;
+	double startUs, durationUs;
+};
+
+// Global aggregate & trace, guarded by a mutex
+static std::mutex g_globalMutex;
+static SplineStats g_globalStats;
+static std::vector<TraceEvent> g_traceEvents;
+static std::atomic<bool> g_isTracingEnabled(false);
+
+// Trace timestamps are relative to this
+static const std::chrono::steady_clock::time_point g_traceStart = std::chrono::steady_clock::now();
+
+// Small sequential id of the calling thread, for the trace
+static int getThreadIdx()
+{
+	static std::atomic<int> nextThreadIdx(0);
+	static thread_local int threadIdx = nextThreadIdx++;
+	return threadIdx;
+}
+
+void SplineStats::clear()
+{
+	for (int i = 0; i < NUM_STAGES; i++) { stageNs[i] = stageRuns[i] = 0; }
+	for (int i = 0; i < NUM_COUNTERS; i++) { counters[i] = 0; }
+}
+
+void SplineStats::add(const SplineStats& other)
+{
+	for (int i = 0; i < NUM_STAGES; i++) { stageNs[i] += other.stageNs[i]; stageRuns[i] += other.stageRuns[i]; }
+	for (int i = 0; i < NUM_COUNTERS; i++) { counters[i] += other.counters[i]; }
+}
+
+const char* SplineStats::getName(Stage stage)
+{
+	static const char* names[NUM_STAGES] = { "findCorners", "segmentTests", "biarcFitting", "shapeCreation" };
+	return names[stage];
+}
+
+const char* SplineStats::getName(Counter counter)
+{
+	static const char* names[NUM_COUNTERS] = { "getPointAt", "getTangentAt", "shapesEmitted" };
+	return names[counter];
+}
+
+Instrumentation::StageTimer::~StageTimer()
+{
+	const std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+	if (currentStats)
+	{
+		currentStats->stageNs[stage] += (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+		++currentStats->stageRuns[stage];
+	}
+	if (g_isTracingEnabled.load(std::memory_order_relaxed))
+	{
+		TraceEvent e;
+		e.stage = stage;
+		e.threadIdx = getThreadIdx();
+		e.startUs = std::chrono::duration<double, std::micro>(start - g_traceStart).count();
+		e.durationUs = std::chrono::duration<double, std::micro>(end - start).count();
+		std::lock_guard<std::mutex> lock(g_globalMutex);
+		g_traceEvents.push_back(e);
+	}
+}
+
+void Instrumentation::addToGlobalStats(const SplineStats& stats)
+{
+	std::lock_guard<std::mutex> lock(g_globalMutex);
+	g_globalStats.add(stats);
+}
+
+SplineStats Instrumentation::getGlobalStats()
+{
+	std::lock_guard<std::mutex> lock(g_globalMutex);
+	return g_globalStats;
+}
+
+void Instrumentation::clearGlobalStats()
+{
+	std::lock_guard<std::mutex> lock(g_globalMutex);
+	g_globalStats.clear();
+}
+
+void Instrumentation::setTracingEnabled(bool isEnabled)
+{
+	g_isTracingEnabled = isEnabled;
+}
+
+void Instrumentation::writeChromeTrace(std::ostream& stream, bool clearEvents /*= true*/)
+{
+	std::lock_guard<std::mutex> lock(g_globalMutex);
+	const std::ios::fmtflags oldFlags = stream.flags();
+	const std::streamsize oldPrecision = stream.precision(3);
+	stream << std::fixed << "{\"traceEvents\":[";
+	for (size_t i = 0; i < g_traceEvents.size(); i++)
+	{
+		const TraceEvent& e = g_traceEvents[i];
+		stream << (i ? ",\n" : "\n") << "{\"name\":\"" << SplineStats::getName(e.stage) << "\",\"cat\":\"ArcSpline\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.threadIdx
+			<< ",\"ts\":" << e.startUs << ",\"dur\":" << e.durationUs << "}";
+	}
+	stream << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	stream.flags(oldFlags);
+	stream.precision(oldPrecision);
+	if (clearEvents) { g_traceEvents.clear(); }
+}
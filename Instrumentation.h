@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+Instrumentation collects per-stage timings & call counters of ArcSpline
+generation, to see where time goes on real strokes without a profiler.
+
+Code marks stages with ME_STAGE_TIMER(stage) & counts calls with
+ME_COUNT(counter). Both record into the SplineStats made current on the
+calling thread with a ScopedStats; nothing is recorded without one. ArcSpline
+keeps its own stats & adds them to the global aggregate after each update.
+Work running on pool threads collects into task-local stats, which are added
+to the spline's stats once the tasks finish.
+
+When tracing is enabled, every stage also becomes a trace event, and the
+events can be written in the Chrome trace-event JSON format (chrome://tracing
+or https://ui.perfetto.dev).
+
+Define ME_ENABLE_INSTRUMENTATION as 1 to compile it in. Otherwise the macros
+expand to nothing, and ArcSpline has no stats member to fill.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#if !defined ME_ENABLE_INSTRUMENTATION
+#	define ME_ENABLE_INSTRUMENTATION 0
+#endif
+
+// Timings & counters of ArcSpline generation
+struct SplineStats
+{
+	// Timed stages
+	enum Stage { STAGE_FIND_CORNERS, STAGE_SEGMENT_TESTS, STAGE_BIARC_FITTING, STAGE_SHAPE_CREATION, NUM_STAGES };
+
+	// Counted events. getPointAt counts every point evaluated on a line, including tangent sampling points; getTangentAt counts tangent queries, including tangent field reads.
+	enum Counter { COUNTER_GET_POINT_AT, COUNTER_GET_TANGENT_AT, COUNTER_SHAPES_EMITTED, NUM_COUNTERS };
+
+	SplineStats() { clear(); }
+
+	// Reset all values to zero
+	void clear();
+
+	// Add values of other stats
+	void add(const SplineStats& other);
+
+	// Name of a stage or counter, for reports
+	static const char* getName(Stage stage);
+	static const char* getName(Counter counter);
+
+	// Time spent in each stage, summed over all threads, and the number of times each stage ran
+	uint64_t stageNs[NUM_STAGES];
+	uint64_t stageRuns[NUM_STAGES];
+
+	// Event counts
+	uint64_t counters[NUM_COUNTERS];
+};
+
+// Thread-local current stats, the global aggregate & the trace.
+class Instrumentation
+{
+public:
+	// Stats recording on this thread; null if none
+	static SplineStats* getCurrentStats() { return currentStats; }
+
+	// Makes stats current on this thread within a scope
+	class ScopedStats
+	{
+	public:
+		explicit ScopedStats(SplineStats* stats) : previous(currentStats) { currentStats = stats; }
+		~ScopedStats() { currentStats = previous; }
+
+	private:
+		SplineStats* previous;
+	};
+
+	// Times a stage within a scope & records it into the current stats & the trace
+	class StageTimer
+	{
+	public:
+		explicit StageTimer(SplineStats::Stage stage) : stage(stage), start(std::chrono::steady_clock::now()) { }
+		~StageTimer();
+
+	private:
+		SplineStats::Stage stage;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	// Count an event in the current stats
+	static void count(SplineStats::Counter counter, uint64_t amount = 1) { if (currentStats) { currentStats->counters[counter] += amount; } }
+
+	// Add stats to the global aggregate; thread-safe
+	static void addToGlobalStats(const SplineStats& stats);
+
+	// Copy of the global aggregate; thread-safe
+	static SplineStats getGlobalStats();
+
+	// Reset the global aggregate; thread-safe
+	static void clearGlobalStats();
+
+	// Record stages as trace events from now on; off by default
+	static void setTracingEnabled(bool isEnabled);
+
+	// Write recorded trace events as Chrome trace JSON & optionally drop them; thread-safe
+	static void writeChromeTrace(std::ostream& stream, bool clearEvents = true);
+
+private:
+	// Stats recording on this thread
+	static thread_local SplineStats* currentStats;
+};
+
+
+#if ME_ENABLE_INSTRUMENTATION
+#	define ME_INSTRUMENTATION_CONCAT_(a, b) a##b
+#	define ME_INSTRUMENTATION_CONCAT(a, b) ME_INSTRUMENTATION_CONCAT_(a, b)
+#	define ME_STAGE_TIMER(stage) Instrumentation::StageTimer ME_INSTRUMENTATION_CONCAT(stageTimer, __LINE__)(SplineStats::stage)
+#	define ME_COUNT(counter) Instrumentation::count(SplineStats::counter)
+#	define ME_COUNT_N(counter, amount) Instrumentation::count(SplineStats::counter, (uint64_t)(amount))
+#	define ME_SCOPED_STATS(stats) Instrumentation::ScopedStats ME_INSTRUMENTATION_CONCAT(scopedStats, __LINE__)(stats)
+#	define ME_ON_INSTRUMENTATION(code) code
+#else
+#	define ME_STAGE_TIMER(stage)
+#	define ME_COUNT(counter)
+#	define ME_COUNT_N(counter, amount)
+#	define ME_SCOPED_STATS(stats)
+#	define ME_ON_INSTRUMENTATION(code)
+#endif
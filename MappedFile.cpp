@@ -0,0 +1,79 @@
+#include "FreeformTool.h"
+#include "MappedFile.h"
+
+#include <cstdio>
+#include <string>
+
+#if defined _WIN32
+#	define WIN32_LEAN_AND_MEAN
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+#if defined _WIN32
+
+MappedFile::MappedFile(const char* fileName) : mappedData(nullptr), mappedSize(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+{
+	// Others may append to the file, or rename & remove it, while it's mapped
+	fileHandle = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (INVALID_HANDLE_VALUE == fileHandle) { return; }
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || 0 == fileSize.QuadPart) { return; }
+
+	mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mappingHandle) { return; }
+
+	mappedData = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (mappedData) { mappedSize = (size_t)fileSize.QuadPart; }
+}
+
+MappedFile::~MappedFile()
+{
+	if (mappedData) { UnmapViewOfFile(mappedData); }
+	if (mappingHandle) { CloseHandle(mappingHandle); }
+	if (INVALID_HANDLE_VALUE != fileHandle) { CloseHandle(fileHandle); }
+}
+
+#else
+
+MappedFile::MappedFile(const char* fileName) : mappedData(nullptr), mappedSize(0), fileHandle(nullptr), mappingHandle(nullptr)
+{
+	// The descriptor can be closed right after mapping
+	const int fd = open(fileName, O_RDONLY);
+	if (fd < 0) { return; }
+
+	struct stat fileStat;
+	if (0 == fstat(fd, &fileStat) && 0 < fileStat.st_size)
+	{
+		void* mapped = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED != mapped)
+		{
+			mappedData = mapped;
+			mappedSize = (size_t)fileStat.st_size;
+		}
+	}
+	close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+	if (mappedData) { munmap(const_cast<void*>(mappedData), mappedSize); }
+}
+
+#endif
+
+bool MappedFile::replace(const char* fileName, const char* newFileName)
+{
+	// Move the old file aside first: while it's mapped on Windows, it can be renamed, but a removed file keeps its name until it's unmapped
+	const std::string oldFileName = std::string(fileName) + ".old";
+	std::remove(oldFileName.c_str());
+	if (0 != std::rename(fileName, oldFileName.c_str())) { std::remove(fileName); }
+	const bool isReplaced = 0 == std::rename(newFileName, fileName);
+	std::remove(oldFileName.c_str());
+	return isReplaced;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+MappedFile maps a whole file read-only into memory, using file mapping on
+Windows & mmap elsewhere. Pages are loaded by the OS on first access, so opening
+even a large file is cheap, and data can be used in place without copying.
+
+Others may still write, rename & remove the file while it's mapped. replace()
+swaps in a new version of a file, also while the old one is mapped.
+
+See: StrokeArchive, SplineCache
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+	// Map the file; check isValid() for success
+	explicit MappedFile(const char* fileName);
+
+	// Unmap the file
+	~MappedFile();
+
+	// Was the file mapped successfully. Empty files can't be mapped.
+	bool isValid() const { return nullptr != mappedData; }
+
+	// Mapped file content & its size in bytes
+	const void* data() const { return mappedData; }
+	size_t size() const { return mappedSize; }
+
+	// Rename newFileName to fileName, replacing it. The old file is moved aside & removed rather than overwritten, so mappings of it stay valid.
+	static bool replace(const char* fileName, const char* newFileName);
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator = (const MappedFile&) = delete;
+
+	// Mapped content
+	const void* mappedData;
+	size_t mappedSize;
+
+	// Platform handles of the open file & mapping
+	void* fileHandle;
+	void* mappingHandle;
+};
@@ -0,0 +1,42 @@
+#include "FreeformTool.h"
+#include "MonotonicArena.h"
+
+#include <algorithm>
+#include <new>
+
+MonotonicArena::~MonotonicArena()
+{
+	for (const Block& b : blocks) { ::operator delete(b.data); }
+}
+
+void* MonotonicArena::allocate(size_t size, size_t alignment)
+{
+	ME_ASSERT(0 < alignment && (alignment & (alignment - 1)) == 0 && alignment <= alignof(std::max_align_t));
+
+	// Use the current block if the allocation fits, otherwise move on to the next one; add a block if none is left
+	for (;;)
+	{
+		if (currentBlock < blocks.size())
+		{
+			const Block& block = blocks[currentBlock];
+			const size_t alignedOffset = (offset + alignment - 1) & ~(alignment - 1);
+			if (alignedOffset + size <= block.size)
+			{
+				offset = alignedOffset + size;
+				return block.data + alignedOffset;
+			}
+			++currentBlock;
+			offset = 0;
+			continue;
+		}
+
+		const size_t blockSize = std::max(size, blocks.empty() ? firstBlockSize : 2 * blocks.back().size);
+		blocks.push_back(Block{ static_cast<char*>(::operator new(blockSize)), blockSize });
+	}
+}
+
+MonotonicArena& MonotonicArena::getForThread()
+{
+	static thread_local MonotonicArena arena;
+	return arena;
+}
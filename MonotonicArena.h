@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "Common.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+MonotonicArena hands out scratch memory by bumping an offset within large
+blocks. Freeing single allocations does nothing; instead the whole arena, or
+everything allocated after a Marker, is rewound at once. Blocks are kept for
+reuse, so once an arena has grown to the size a task needs, repeating the task
+makes no heap allocations at all.
+
+Each thread has its own arena, see getForThread(). A Scope rewinds it when it
+goes out of scope, so scratch lists of a function are released on return.
+Scopes nest like function calls, which also holds for tasks that a thread
+runs while it waits in ThreadPool::parallelFor().
+
+Std containers use the arena through ArenaAllocator, e.g. ArenaVector. Such a
+container must not outlive the Scope it was allocated in. Without an arena,
+ArenaAllocator falls back to the heap, so the same container type can also
+hold persistent data.
+
+See: ArcSpline, ThreadPool
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Bump allocator over reusable memory blocks; not thread-safe.
+class MonotonicArena
+{
+public:
+	// Position in the arena, to rewind to
+	struct Marker
+	{
+		size_t blockIdx, offset;
+	};
+
+	// Rewinds the calling thread's arena to where it was at construction
+	class Scope
+	{
+	public:
+		Scope() : arena(MonotonicArena::getForThread()), marker(arena.getMarker()) { }
+		~Scope() { arena.rewind(marker); }
+
+		// Arena of the scope
+		MonotonicArena* getArena() const { return &arena; }
+
+	private:
+		Scope(const Scope&) = delete;
+		Scope& operator = (const Scope&) = delete;
+
+		MonotonicArena& arena;
+		const Marker marker;
+	};
+
+	// Create an empty arena; the first block is allocated on demand
+	explicit MonotonicArena(size_t firstBlockSize = 64 * 1024) : currentBlock(0), offset(0), firstBlockSize(firstBlockSize) { }
+
+	// Free all blocks
+	~MonotonicArena();
+
+	// Allocate size bytes aligned to alignment, which must be at most alignof(std::max_align_t)
+	void* allocate(size_t size, size_t alignment);
+
+	// Current position, to rewind to later
+	Marker getMarker() const { return Marker{ currentBlock, offset }; }
+
+	// Release everything allocated after the marker was taken; the memory is kept for reuse
+	void rewind(const Marker& marker) { ME_ASSERT(marker.blockIdx <= currentBlock); currentBlock = marker.blockIdx; offset = marker.offset; }
+
+	// Release all allocations; the memory is kept for reuse
+	void reset() { rewind(Marker{ 0, 0 }); }
+
+	// Number of blocks allocated from the heap so far; it stops growing once the arena is large enough for its tasks
+	int getNumBlocks() const { return (int)blocks.size(); }
+
+	// Arena of the calling thread
+	static MonotonicArena& getForThread();
+
+private:
+	MonotonicArena(const MonotonicArena&) = delete;
+	MonotonicArena& operator = (const MonotonicArena&) = delete;
+
+	// A heap block
+	struct Block
+	{
+		char* data;
+		size_t size;
+	};
+
+	// All blocks, in order of use
+	std::vector<Block> blocks;
+
+	// Block & offset of the next allocation
+	size_t currentBlock, offset;
+
+	// Size of the first block; later blocks double
+	size_t firstBlockSize;
+};
+
+
+// Std allocator drawing from a MonotonicArena; deallocation is a no-op. Without an arena it uses the heap.
+template <class T> class ArenaAllocator
+{
+public:
+	typedef T value_type;
+
+	// Allocate from the heap
+	ArenaAllocator() : arena(nullptr) { }
+
+	// Allocate from the arena; null uses the heap
+	ArenaAllocator(MonotonicArena* arena) : arena(arena) { }
+
+	// Rebind
+	template <class U> ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) { }
+
+	// Allocate & free memory for n objects
+	T* allocate(size_t n) { return static_cast<T*>(arena ? arena->allocate(n * sizeof(T), alignof(T)) : ::operator new(n * sizeof(T))); }
+	void deallocate(T* p, size_t /*n*/) { if (!arena) { ::operator delete(p); } }
+
+	// Allocators of the same arena can free each other's memory
+	template <class U> bool operator == (const ArenaAllocator<U>& b) const { return arena == b.arena; }
+	template <class U> bool operator != (const ArenaAllocator<U>& b) const { return arena != b.arena; }
+
+	// Arena to allocate from; null for the heap
+	MonotonicArena* arena;
+};
+
+// Vector whose memory comes from a MonotonicArena, or from the heap if it's constructed without one
+template <class T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
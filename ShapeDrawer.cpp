@@ -75,13 +75,11 @@ int ShapeDrawer::drawFreeformLine(const FreeformLine& line, int startAt /*= 0*/,
 	int paleGray = 196;
 	Gdiplus::Pen      grayPen(Gdiplus::Color(255, paleGray, paleGray, paleGray));
 
-	std::vector<Gdiplus::Point> points(line.points.size()-startAt);
+	std::vector<Gdiplus::Point> points(line.numPoints()-startAt);
 	Gdiplus::Point* dst = &*points.begin();
-	auto it = line.points.begin();
-	for (int i = 0; i < startAt; i++, it++) {}
-	for (; it != line.points.end(); it++) { *dst++ = Gdiplus::Point((int)it->second.x, (int)it->second.y); }
+	for (int i = startAt; i < line.numPoints(); i++) { *dst++ = Gdiplus::Point((int)line.pointXs[i], (int)line.pointYs[i]); }
 	graphics->DrawLines(pen ? pen : &grayPen, &points.front(), points.size());
-	return line.points.size()-2;
+	return line.numPoints()-2;
 }
 
 void ShapeDrawer::drawArcSpline(const ArcSpline& spline, float brushWidth /*= 2.0f*/)
@@ -92,30 +90,26 @@ void ShapeDrawer::drawArcSpline(const ArcSpline& spline, float brushWidth /*= 2.
 	Gdiplus::Pen      bluePen(Gdiplus::Color(255, 100, 100, 255)); bluePen.SetWidth(brushWidth);
 	Gdiplus::Pen      redPen(Gdiplus::Color(255, 255, 0, 0)); redPen.SetWidth(brushWidth);
 
+	// Snapshot; the spline may be recomputed meanwhile
+	const ref<const SplineResult> result = spline.getResult();
+
 	const bool drawCross = true;
-	for (const auto& v : spline.debugCorners) { drawPoint(v, !drawCross, &grayPen, 7); }
+	for (const auto& v : result->debugCorners) { drawPoint(v, !drawCross, &grayPen, 7); }
 
 	Gdiplus::Pen* colors[] = { &blackPen, &bluePen, &redPen };
 
-	for (SplineElement* shape : spline.displayShapes)
+	for (const SplineElement& shape : result->displayShapes)
 	{
-		switch (shape->type)
+		drawPoint(shape.p1, drawCross, &crossPen, 3);
+		switch (shape.type)
 		{
 		case SplineElement::TYPE_SEGMENT:
-			{
-				const SplineSegment& segment = *static_cast<SplineSegment*>(shape);
-				drawPoint(segment.p1, drawCross, &crossPen, 3);
-				graphics->DrawLine(colors[segment.idxInBiarc+1], toGdiPointF(segment.p0), toGdiPointF(segment.p1));
-			}
+			graphics->DrawLine(colors[shape.idxInBiarc + 1], toGdiPointF(shape.p0), toGdiPointF(shape.p1));
 			break;
 		case SplineElement::TYPE_ARC:
 			{
-				const SplineArc& arc = *static_cast<SplineArc*>(shape);
-				Vector2 endPoint = arc.circle.center() + Vector2(arc.circle.radius, 0.0f).rotate((arc.startAngle + arc.sweepAngle) * ME_DEG_TO_RAD);
-				drawPoint(endPoint, drawCross, &crossPen, 3);
-
-				Gdiplus::RectF rect(toGdiPointF(arc.circle.center()), Gdiplus::SizeF()); rect.Inflate(arc.circle.radius, arc.circle.radius);
-				graphics->DrawArc(colors[arc.idxInBiarc + 1], rect, arc.startAngle, arc.sweepAngle);
+				Gdiplus::RectF rect(toGdiPointF(shape.circle.center()), Gdiplus::SizeF()); rect.Inflate(shape.circle.radius, shape.circle.radius);
+				graphics->DrawArc(colors[shape.idxInBiarc + 1], rect, shape.startAngle, shape.sweepAngle);
 			}
 			break;
 		}
@@ -144,8 +138,8 @@ void ShapeDrawer::drawTweakUtil(const TweakUtil& util)
 			Vector2 center = Vector2::interpolate(points[i], points[i + 1], 0.5f) + points[i].directionTo(points[i + 1]).rotate90() * (radius - 1.0f *relativeDisplacement * halfSize);
 			Vector2 arm0 = points[i] - center;
 			Vector2 arm1 = points[i + 1] - center;
-			float aStart = std::atan2f(arm0.y, arm0.x) * ME_RAD_TO_DEG;
-			float aEnd = std::atan2f(arm1.y, arm1.x) * ME_RAD_TO_DEG;
+			float aStart = std::atan2(arm0.y, arm0.x) * ME_RAD_TO_DEG;
+			float aEnd = std::atan2(arm1.y, arm1.x) * ME_RAD_TO_DEG;
 			if (std::fabs(aStart - aEnd) > 180.0f) { aEnd += aStart < aEnd ? -360.0f : 360.0f; }
 
 			center += util.centerPoint;
@@ -175,7 +169,7 @@ void ShapeDrawer::drawTweakUtil(const TweakUtil& util)
 		WCHAR buffer[1024];
 		int writeAt = 0;
 		for (auto t : util.tweakables) { if (t.label) writeAt += swprintf_s(buffer + writeAt, 1024 - writeAt, L"%s%s: %s: %7.2f\n\r", t.valueMultiplierAtSliderMax >= 1.0f ? L" " : L"-", t.bindingAxis ? L"y" : L"x", t.label, *t.variable); }
-		swprintf_s(buffer + writeAt, 1024 - writeAt, L"    Num elements: %d", util.spline->displayShapes.size());
+		swprintf_s(buffer + writeAt, 1024 - writeAt, L"    Num elements: %d", util.spline->getResult()->displayShapes.size());
 
 		Gdiplus::LinearGradientBrush brush(Gdiplus::Rect(0, 0, 100, 100), Gdiplus::Color::Gray, Gdiplus::Color::DimGray, Gdiplus::LinearGradientModeHorizontal);
 		Vector2 textOrigin = util.centerPoint + Vector2::unitY * util.halfSize.y * 1.2f - Vector2::unitX * 165.0f;
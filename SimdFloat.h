@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cmath>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+SimdFloat is a minimal wrapper of a SIMD register of floats. Kernels are written
+once as templates over the lane type, and instantiated for both SimdFloat and
+plain float (for loop tails & the scalar fallback).
+
+The widest instruction set enabled for the build is used: AVX2 (8 lanes), SSE2
+(4 lanes), or a scalar fallback (1 lane). Define ME_DISABLE_SIMD to force the
+scalar fallback.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+#if !defined(ME_DISABLE_SIMD) && defined(__AVX2__)
+#	define ME_SIMD_AVX2 1
+#	include <immintrin.h>
+#elif !defined(ME_DISABLE_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#	define ME_SIMD_SSE2 1
+#	include <emmintrin.h>
+#endif
+
+
+#if ME_SIMD_AVX2
+
+// Eight float lanes
+struct SimdFloat
+{
+	static const int width = 8;
+
+	SimdFloat() { }
+	SimdFloat(float f) : v(_mm256_set1_ps(f)) { } // broadcast
+	SimdFloat(__m256 v) : v(v) { }
+
+	static SimdFloat load(const float* p) { return _mm256_loadu_ps(p); }
+	void store(float* p) const { _mm256_storeu_ps(p, v); }
+
+	SimdFloat operator + (const SimdFloat& b) const { return _mm256_add_ps(v, b.v); }
+	SimdFloat operator - (const SimdFloat& b) const { return _mm256_sub_ps(v, b.v); }
+	SimdFloat operator * (const SimdFloat& b) const { return _mm256_mul_ps(v, b.v); }
+
+	// Sum of all lanes
+	float sum() const { float f[width]; store(f); return ((f[0] + f[1]) + (f[2] + f[3])) + ((f[4] + f[5]) + (f[6] + f[7])); }
+
+	__m256 v;
+};
+
+inline SimdFloat simdSqrt(const SimdFloat& a) { return _mm256_sqrt_ps(a.v); }
+inline SimdFloat selectIfNonNegative(const SimdFloat& condition, const SimdFloat& a, const SimdFloat& b) { return _mm256_blendv_ps(b.v, a.v, _mm256_cmp_ps(condition.v, _mm256_setzero_ps(), _CMP_GE_OQ)); }
+
+#elif ME_SIMD_SSE2
+
+// Four float lanes
+struct SimdFloat
+{
+	static const int width = 4;
+
+	SimdFloat() { }
+	SimdFloat(float f) : v(_mm_set1_ps(f)) { } // broadcast
+	SimdFloat(__m128 v) : v(v) { }
+
+	static SimdFloat load(const float* p) { return _mm_loadu_ps(p); }
+	void store(float* p) const { _mm_storeu_ps(p, v); }
+
+	SimdFloat operator + (const SimdFloat& b) const { return _mm_add_ps(v, b.v); }
+	SimdFloat operator - (const SimdFloat& b) const { return _mm_sub_ps(v, b.v); }
+	SimdFloat operator * (const SimdFloat& b) const { return _mm_mul_ps(v, b.v); }
+
+	// Sum of all lanes
+	float sum() const { float f[width]; store(f); return (f[0] + f[1]) + (f[2] + f[3]); }
+
+	__m128 v;
+};
+
+inline SimdFloat simdSqrt(const SimdFloat& a) { return _mm_sqrt_ps(a.v); }
+inline SimdFloat selectIfNonNegative(const SimdFloat& condition, const SimdFloat& a, const SimdFloat& b)
+{
+	__m128 mask = _mm_cmpge_ps(condition.v, _mm_setzero_ps());
+	return _mm_or_ps(_mm_and_ps(mask, a.v), _mm_andnot_ps(mask, b.v));
+}
+
+#else
+
+// Scalar fallback; a single float lane
+struct SimdFloat
+{
+	static const int width = 1;
+
+	SimdFloat() { }
+	SimdFloat(float f) : v(f) { }
+
+	static SimdFloat load(const float* p) { return *p; }
+	void store(float* p) const { *p = v; }
+
+	SimdFloat operator + (const SimdFloat& b) const { return v + b.v; }
+	SimdFloat operator - (const SimdFloat& b) const { return v - b.v; }
+	SimdFloat operator * (const SimdFloat& b) const { return v * b.v; }
+
+	// Sum of all lanes
+	float sum() const { return v; }
+
+	float v;
+};
+
+inline SimdFloat simdSqrt(const SimdFloat& a) { return std::sqrt(a.v); }
+inline SimdFloat selectIfNonNegative(const SimdFloat& condition, const SimdFloat& a, const SimdFloat& b) { return condition.v >= 0.0f ? a : b; }
+
+#endif
+
+// Plain float versions, for using the same kernels on loop tails
+inline float simdSqrt(float a) { return std::sqrt(a); }
+inline float selectIfNonNegative(float condition, float a, float b) { return condition >= 0.0f ? a : b; }
@@ -0,0 +1,245 @@
+#include "FreeformTool.h"
+#include "SplineCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "ArcSpline.h"
+#include "FreeformLine.h"
+#include "MappedFile.h"
+
+static const char g_cacheMagic[8] = { 'F', 'F', 'S', 'P', 'L', 'I', 'N', 'E' };
+static const uint64_t g_dataAlignment = 16;
+
+// Call f with each setting of the input, in stored order
+template <class TInput, class TFunc> static void visitSettings(TInput& input, TFunc f)
+{
+	f(input.corners.tStep); f(input.corners.innerMinAngleInDeg); f(input.corners.outerMaxAngleInDeg);
+	f(input.corners.minNumberTestPositivesInSeries); f(input.corners.maxDistBetweenCornersToMerge);
+	f(input.corners.innerInterMeasurementFactor); f(input.corners.outerInterMeasurementFactor); f(input.corners.coarseToFine);
+	f(input.segments.tStep); f(input.segments.maxMeanErrorAtReferenceLength); f(input.segments.referenceSegmentLength);
+	f(input.biarcs.tStep); f(input.biarcs.maxMeanError); f(input.biarcs.maxBiarcRatio); f(input.biarcs.minBiarcRatio); f(input.biarcs.numBiarcRatioSamples);
+	f(input.biarcs.distToErrorThreshold); f(input.biarcs.endOfLineOkayFactor); f(input.biarcs.allowHalfArcAtSectionEnd); f(input.biarcs.endAngleTolerance);
+	f(input.biarcs.allowExtraToleranceForSingleArcSections); f(input.biarcs.endAngleToleranceForSingleArcSection);
+}
+
+// Raw 32-bit value of a setting & back
+static uint32_t toWord(float v) { uint32_t w; std::memcpy(&w, &v, sizeof(w)); return w; }
+static uint32_t toWord(unsigned int v) { return v; }
+static uint32_t toWord(int v) { return (uint32_t)v; }
+static uint32_t toWord(bool v) { return v ? 1 : 0; }
+static void fromWord(uint32_t w, float* v) { std::memcpy(v, &w, sizeof(w)); }
+static void fromWord(uint32_t w, unsigned int* v) { *v = w; }
+static void fromWord(uint32_t w, int* v) { *v = (int)w; }
+static void fromWord(uint32_t w, bool* v) { *v = 0 != w; }
+
+// FNV-1a over 32-bit words; numBytes must be a multiple of 4
+static uint64_t hashWords(uint64_t hash, const void* data, size_t numBytes)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	for (size_t i = 0; i < numBytes; i += 4)
+	{
+		uint32_t word;
+		std::memcpy(&word, bytes + i, sizeof(word));
+		hash = (hash ^ word) * 0x100000001b3ull;
+	}
+	return hash;
+}
+static const uint64_t g_hashSeed = 0xcbf29ce484222325ull;
+
+SplineCache::SplineCache(const char* fileName) : file(new MappedFile(fileName)), header(nullptr), index(nullptr)
+{
+	if (!file->isValid() || file->size() < sizeof(Header)) { return; }
+
+	// Check header & index bounds; caches of other algorithm versions are stale
+	const char* data = static_cast<const char*>(file->data());
+	const uint64_t size = file->size();
+	const Header* h = reinterpret_cast<const Header*>(data);
+	if (0 != std::memcmp(h->magic, g_cacheMagic, sizeof(g_cacheMagic)) || version != h->version) { return; }
+	if (ArcSpline::algorithmVersion != h->algorithmVersion || sizeof(StoredElement) != h->elementSize) { return; }
+	if (h->indexOffset % alignof(IndexEntry) || size < h->indexOffset || (size - h->indexOffset) / sizeof(IndexEntry) < h->numEntries) { return; }
+
+	// Check each entry's data bounds & the order, so find() can trust the index
+	const IndexEntry* entries = reinterpret_cast<const IndexEntry*>(data + h->indexOffset);
+	for (uint32_t i = 0; i < h->numEntries; i++)
+	{
+		const IndexEntry& e = entries[i];
+		const uint64_t dataSize = sizeof(StoredElement) * uint64_t(e.numShapes) + sizeof(Vector2) * uint64_t(e.numCorners);
+		if (e.dataOffset % g_dataAlignment || size < e.dataOffset || size - e.dataOffset < dataSize) { return; }
+		if (0 < i && !(entries[i - 1] < e)) { return; }
+	}
+
+	header = h;
+	index = entries;
+}
+
+SplineCache::~SplineCache()
+{
+}
+
+bool SplineCache::find(const FreeformLine& line, int strokeIdx, bool isInputMatched, ArcSplineUtil::ProcessingInput* input, SplineResult* result) const
+{
+	if (!isValid()) { return false; }
+
+	IndexEntry key = { };
+	key.strokeHash = hashStroke(line);
+	key.inputHash = isInputMatched ? hashInput(*input) : 0;
+	const IndexEntry* end = index + header->numEntries;
+	const IndexEntry* e = std::lower_bound(index, end, key);
+	if (e == end || e->strokeHash != key.strokeHash || (isInputMatched && e->inputHash != key.inputHash)) { return false; }
+
+	// Without matching the input, the entry stored at strokeIdx is taken. Other entries of the stroke only do if they all have the same input.
+	if (!isInputMatched)
+	{
+		const IndexEntry* first = e;
+		bool isAmbiguous = false;
+		for (; e != end && e->strokeHash == key.strokeHash && e->strokeIdx != uint64_t(strokeIdx); e++) { isAmbiguous |= e->inputHash != first->inputHash; }
+		if (e == end || e->strokeHash != key.strokeHash)
+		{
+			if (isAmbiguous) { return false; }
+			e = first;
+		}
+	}
+
+	if (!isInputMatched) { loadSettings(e->settings, input); }
+	const char* data = static_cast<const char*>(file->data()) + e->dataOffset;
+	const StoredElement* shapes = reinterpret_cast<const StoredElement*>(data);
+	const Vector2* corners = reinterpret_cast<const Vector2*>(data + sizeof(StoredElement) * e->numShapes);
+	result->displayShapes.resize(e->numShapes);
+	for (uint32_t i = 0; i < e->numShapes; i++) { result->displayShapes[i] = loadElement(shapes[i]); }
+	result->debugCorners.assign(corners, corners + e->numCorners);
+	return true;
+}
+
+bool SplineCache::write(const char* fileName, const std::vector<ref<ArcSpline>>& splines)
+{
+	// Key all results first, so the index can be sorted
+	struct Item
+	{
+		IndexEntry entry;
+		ref<const SplineResult> result;
+	};
+	std::vector<Item> items(splines.size());
+	for (size_t i = 0; i < splines.size(); i++)
+	{
+		const ArcSpline& spline = *splines[i];
+		Item& item = items[i];
+		item.entry = IndexEntry();
+		item.entry.strokeHash = hashStroke(*spline.sourceLine);
+		item.entry.inputHash = hashInput(*spline.processingInput);
+		item.entry.strokeIdx = i;
+		storeSettings(*spline.processingInput, item.entry.settings);
+		item.result = spline.getResult();
+	}
+	std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) { return a.entry < b.entry; });
+
+	// Write a temporary file & replace the old one with it
+	const std::string tempFileName = std::string(fileName) + ".tmp";
+	{
+		std::ofstream stream(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!stream) { return false; }
+
+		// The header is written last, once the index offset is known
+		const Header placeholder = { };
+		stream.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+		static const char padding[g_dataAlignment] = { };
+		uint64_t offset = sizeof(Header);
+		std::vector<IndexEntry> entries;
+		entries.reserve(items.size());
+		std::vector<StoredElement> elements;
+		for (Item& item : items)
+		{
+			// Align each result, so elements can be read in place
+			const uint64_t numPadding = (g_dataAlignment - offset % g_dataAlignment) % g_dataAlignment;
+			stream.write(padding, numPadding);
+			offset += numPadding;
+
+			const SplineResult& result = *item.result;
+			item.entry.dataOffset = offset;
+			item.entry.numShapes = (uint32_t)result.displayShapes.size();
+			item.entry.numCorners = (uint32_t)result.debugCorners.size();
+			elements.resize(result.displayShapes.size());
+			std::transform(result.displayShapes.begin(), result.displayShapes.end(), elements.begin(), storeElement);
+			stream.write(reinterpret_cast<const char*>(elements.data()), elements.size() * sizeof(StoredElement));
+			stream.write(reinterpret_cast<const char*>(result.debugCorners.data()), result.debugCorners.size() * sizeof(Vector2));
+			offset += sizeof(StoredElement) * uint64_t(item.entry.numShapes) + sizeof(Vector2) * uint64_t(item.entry.numCorners);
+			entries.push_back(item.entry);
+		}
+
+		// Index & header
+		const uint64_t numPadding = (alignof(IndexEntry) - offset % alignof(IndexEntry)) % alignof(IndexEntry);
+		stream.write(padding, numPadding);
+		offset += numPadding;
+		stream.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(IndexEntry));
+
+		Header h;
+		std::memcpy(h.magic, g_cacheMagic, sizeof(g_cacheMagic));
+		h.version = version;
+		h.algorithmVersion = ArcSpline::algorithmVersion;
+		h.elementSize = sizeof(StoredElement);
+		h.numEntries = (uint32_t)entries.size();
+		h.indexOffset = offset;
+		stream.seekp(0);
+		stream.write(reinterpret_cast<const char*>(&h), sizeof(h));
+		if (!stream.flush()) { return false; }
+	}
+	return MappedFile::replace(fileName, tempFileName.c_str());
+}
+
+SplineCache::StoredElement SplineCache::storeElement(const SplineElement& element)
+{
+	StoredElement stored = { };
+	stored.type = element.type;
+	stored.idxInBiarc = element.idxInBiarc;
+	stored.p0x = element.p0.x; stored.p0y = element.p0.y;
+	stored.p1x = element.p1.x; stored.p1y = element.p1.y;
+	stored.circleX = element.circle.x; stored.circleY = element.circle.y; stored.radius = element.circle.radius;
+	stored.startAngle = element.startAngle;
+	stored.sweepAngle = element.sweepAngle;
+	return stored;
+}
+
+SplineElement SplineCache::loadElement(const StoredElement& stored)
+{
+	SplineElement element;
+	element.type = SplineElement::Type(stored.type);
+	element.idxInBiarc = stored.idxInBiarc;
+	element.p0 = Vector2(stored.p0x, stored.p0y);
+	element.p1 = Vector2(stored.p1x, stored.p1y);
+	element.circle.x = stored.circleX; element.circle.y = stored.circleY; element.circle.radius = stored.radius;
+	element.startAngle = stored.startAngle;
+	element.sweepAngle = stored.sweepAngle;
+	return element;
+}
+
+uint64_t SplineCache::hashStroke(const FreeformLine& line)
+{
+	const float settings[] = { line.halfSmoothingSpread, line.tangentFieldResolution, line.areMomentsKept() ? 1.0f : 0.0f };
+	uint64_t hash = hashWords(g_hashSeed, settings, sizeof(settings));
+	hash = hashWords(hash, line.pointTs, line.numPoints() * sizeof(float));
+	hash = hashWords(hash, line.pointXs, line.numPoints() * sizeof(float));
+	return hashWords(hash, line.pointYs, line.numPoints() * sizeof(float));
+}
+
+uint64_t SplineCache::hashInput(const ArcSplineUtil::ProcessingInput& input)
+{
+	uint32_t settings[numSettings];
+	storeSettings(input, settings);
+	return hashWords(g_hashSeed, settings, sizeof(settings));
+}
+
+void SplineCache::storeSettings(const ArcSplineUtil::ProcessingInput& input, uint32_t* settings)
+{
+	int numStored = 0;
+	visitSettings(input, [&](const auto& v) { settings[numStored++] = toWord(v); });
+	ME_ASSERT(numStored == numSettings);
+}
+
+void SplineCache::loadSettings(const uint32_t* settings, ArcSplineUtil::ProcessingInput* input)
+{
+	int numLoaded = 0;
+	visitSettings(*input, [&](auto& v) { fromWord(settings[numLoaded++], &v); });
+	ME_ASSERT(numLoaded == numSettings);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "ArcSplineUtil.h"
+#include "Common.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+SplineCache is a binary file of computed spline results, so loading saved lines
+doesn't have to convert them again.
+
+Each result is keyed by a hash of its stroke, i.e. the stored points & the
+line's smoothing & moments settings, and by a hash of the ProcessingInput it was
+computed with. The ProcessingInput is stored too, so settings tweaked before
+saving come back with the result. Identical strokes tweaked differently are
+told apart by their index among the written splines.
+
+Layout, all values in native byte order; files of the other byte order are
+rejected, as their version doesn't match:
+  Header      magic "FFSPLINE", version, ArcSpline::algorithmVersion, size of a
+              stored element, number of entries, offset of the index
+  Data        for each entry, 16-byte aligned: elements, then corners
+  Index       for each entry, sorted by stroke & input hash & index: both
+              hashes, the index of the spline among the written ones, offset
+              of its data, number of elements & corners, and the
+              ProcessingInput settings
+
+Elements are stored field by field, without padding, so equal results give
+equal files. The file is memory mapped & checked when opened; a file written
+by another version of the algorithm or of the format is simply not valid, so
+bumping ArcSpline::algorithmVersion invalidates all caches at the cost of a
+header check. Lookups are binary searches in the index & copy only the found result.
+
+See: ArcSpline, StrokeArchive, BulkLoader
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+class ArcSpline;
+class FreeformLine;
+class MappedFile;
+struct SplineElement;
+struct SplineResult;
+
+// Binary file of ArcSpline results, keyed by stroke & ProcessingInput.
+class SplineCache
+{
+public:
+	// Map & validate the cache; check isValid() for success
+	explicit SplineCache(const char* fileName);
+
+	// Unmap the file
+	~SplineCache();
+
+	// Was the file mapped & is it a cache of the current algorithm
+	bool isValid() const { return nullptr != header; }
+
+	// Number of stored results
+	int numEntries() const { return isValid() ? (int)header->numEntries : 0; }
+
+	// Find a stored result for the line. With isInputMatched, only a result computed with input's settings is taken; otherwise input is set to the
+	// settings stored with the result, e.g. tweaked before saving. That's the result stored at strokeIdx, i.e. the line's position among the written
+	// splines, if it's of the same stroke; else any result of the stroke, unless they have different settings. Returns false if there's none.
+	bool find(const FreeformLine& line, int strokeIdx, bool isInputMatched, ArcSplineUtil::ProcessingInput* input, SplineResult* result) const;
+
+	// Write the published results of the splines, with their processingInput, into a new cache, replacing the file. It's moved aside rather than
+	// overwritten, see MappedFile::replace().
+	static bool write(const char* fileName, const std::vector<ref<ArcSpline>>& splines);
+
+	// Hash of the stored points & processing settings of a line
+	static uint64_t hashStroke(const FreeformLine& line);
+
+	// Hash of all settings
+	static uint64_t hashInput(const ArcSplineUtil::ProcessingInput& input);
+
+	// Current format version
+	static const uint32_t version = 3;
+
+private:
+	SplineCache(const SplineCache&) = delete;
+	SplineCache& operator = (const SplineCache&) = delete;
+
+	// Number of ProcessingInput settings
+	static const int numSettings = 22;
+
+	// File header
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t algorithmVersion;
+		uint32_t elementSize;
+		uint32_t numEntries;
+		uint64_t indexOffset;
+	};
+
+	// Index entry of a single result
+	struct IndexEntry
+	{
+		uint64_t strokeHash, inputHash, strokeIdx;
+		uint64_t dataOffset;
+		uint32_t numShapes, numCorners;
+		uint32_t settings[numSettings];
+
+		bool operator < (const IndexEntry& b) const
+		{
+			if (strokeHash != b.strokeHash) { return strokeHash < b.strokeHash; }
+			return inputHash < b.inputHash || (inputHash == b.inputHash && strokeIdx < b.strokeIdx);
+		}
+	};
+
+	// SplineElement as stored, without padding
+	struct StoredElement
+	{
+		int8_t type, idxInBiarc;
+		uint8_t reserved[2];
+		float p0x, p0y, p1x, p1y;
+		float circleX, circleY, radius;
+		float startAngle, sweepAngle;
+	};
+
+	// Convert an element to its stored form & back
+	static StoredElement storeElement(const SplineElement& element);
+	static SplineElement loadElement(const StoredElement& stored);
+
+	// Store & restore the settings of a ProcessingInput as raw 32-bit values
+	static void storeSettings(const ArcSplineUtil::ProcessingInput& input, uint32_t* settings);
+	static void loadSettings(const uint32_t* settings, ArcSplineUtil::ProcessingInput* input);
+
+	// Mapped file
+	std::unique_ptr<const MappedFile> file;
+
+	// Header & index within the mapped file; null if the file is not valid
+	const Header* header;
+	const IndexEntry* index;
+};
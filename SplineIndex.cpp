@@ -0,0 +1,174 @@
+#include "FreeformTool.h"
+#include "SplineIndex.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "ArcSpline.h"
+
+// Cells farther from the origin are clamped; no real canvas gets there
+#define ME_MAX_CELL_COORD (1 << 30)
+
+// Bounding box of an element
+static void getBounds(const SplineElement& element, Range* outX, Range* outY)
+{
+	outX->invalidate();
+	outY->invalidate();
+	switch (element.type)
+	{
+	case SplineElement::TYPE_ARC:
+	{
+		// Endpoints & the extreme points of the circle that lie on the arc
+		const float endAngle = element.startAngle + element.sweepAngle;
+		const float start = std::fmin(element.startAngle, endAngle);
+		const float end = std::fmax(element.startAngle, endAngle);
+		const Circle& circle = element.circle;
+		outX->include(element.p0.x); outY->include(element.p0.y);
+		outX->include(element.p1.x); outY->include(element.p1.y);
+		for (float quarter = std::ceil(start / 90.0f); quarter * 90.0f <= end; quarter += 1.0f)
+		{
+			switch ((int(quarter) % 4 + 4) % 4)
+			{
+			case 0: outX->include(circle.x + circle.radius); break;
+			case 1: outY->include(circle.y + circle.radius); break;
+			case 2: outX->include(circle.x - circle.radius); break;
+			case 3: outY->include(circle.y - circle.radius); break;
+			}
+		}
+		break;
+	}
+	case SplineElement::TYPE_SEGMENT:
+		outX->include(element.p0.x); outY->include(element.p0.y);
+		outX->include(element.p1.x); outY->include(element.p1.y);
+		break;
+	default:
+		break;
+	}
+}
+
+SplineIndex::SplineIndex(float cellSize /*= 32.0f*/) : cellSize(cellSize)
+{
+	ME_ASSERT(0.0f < cellSize);
+}
+
+void SplineIndex::add(ArcSpline* spline)
+{
+	ME_ASSERT(spline);
+	splines.push_back(IndexedSpline());
+	splines.back().spline = spline;
+	insertElements((int)splines.size() - 1);
+}
+
+void SplineIndex::update(const ArcSpline* spline)
+{
+	// Recently added splines are the likely ones to change
+	for (int i = (int)splines.size() - 1; 0 <= i; i--)
+	{
+		if (splines[i].spline != spline) { continue; }
+		removeElements(i);
+		insertElements(i);
+		return;
+	}
+	ME_ASSERT(false && "Spline is not in the index");
+}
+
+void SplineIndex::clear()
+{
+	cells.clear();
+	splines.clear();
+}
+
+ArcSpline* SplineIndex::findLatestElementInDistance(const Vector2& point, bool* outIsEndpointHit, float maxDist, float testDistForEndpoints) const
+{
+	*outIsEndpointHit = false;
+
+	// Test elements of all cells within maxDist, keeping the latest one in distance
+	int firstX, lastX, firstY, lastY;
+	getCellRange(point.x - maxDist, point.x + maxDist, &firstX, &lastX);
+	getCellRange(point.y - maxDist, point.y + maxDist, &firstY, &lastY);
+
+	Entry best = { -1, -1 };
+	const SplineElement* bestElement = nullptr;
+	for (int x = firstX; x <= lastX; x++)
+	{
+		for (int y = firstY; y <= lastY; y++)
+		{
+			auto cell = cells.find(getCellKey(x, y));
+			if (cell == cells.end()) { continue; }
+			for (const Entry& e : cell->second)
+			{
+				// Elements listed in several cells are skipped here after the first test
+				if (!e.isLaterThan(best)) { continue; }
+				const SplineElement& element = splines[e.splineIdx].result->displayShapes[e.elementIdx];
+				if (element.distTo(point) <= maxDist)
+				{
+					best = e;
+					bestElement = &element;
+				}
+			}
+		}
+	}
+
+	if (!bestElement) { return nullptr; }
+	*outIsEndpointHit = bestElement->distToEndPoint(point) <= testDistForEndpoints;
+	return splines[best.splineIdx].spline;
+}
+
+void SplineIndex::insertElements(int splineIdx)
+{
+	IndexedSpline& indexed = splines[splineIdx];
+	indexed.result = indexed.spline->getResult();
+	const std::vector<SplineElement>& elements = indexed.result->displayShapes;
+
+	// Any point within a cell is this close to its center; a little slack covers rounding of distTo()
+	const float maxDistToCellCenter = cellSize * 0.5f * std::sqrt(2.0f) * 1.001f + 0.01f;
+
+	for (int elementIdx = 0; elementIdx < (int)elements.size(); elementIdx++)
+	{
+		const SplineElement& element = elements[elementIdx];
+		Range boundsX, boundsY;
+		getBounds(element, &boundsX, &boundsY);
+		if (!boundsX.isValid()) { continue; }
+
+		int firstX, lastX, firstY, lastY;
+		getCellRange(boundsX.start, boundsX.end, &firstX, &lastX);
+		getCellRange(boundsY.start, boundsY.end, &firstY, &lastY);
+
+		// Elements spanning few cells are listed in all of them. Larger ones, e.g. long diagonal segments, only in cells they pass through.
+		const bool isSmall = lastX - firstX <= 1 && lastY - firstY <= 1;
+		for (int x = firstX; x <= lastX; x++)
+		{
+			for (int y = firstY; y <= lastY; y++)
+			{
+				const Vector2 cellCenter((float(x) + 0.5f) * cellSize, (float(y) + 0.5f) * cellSize);
+				if (!isSmall && maxDistToCellCenter < element.distTo(cellCenter)) { continue; }
+
+				const uint64_t key = getCellKey(x, y);
+				std::vector<Entry>& cell = cells[key];
+				if (cell.empty() || cell.back().splineIdx != splineIdx) { indexed.cellKeys.push_back(key); }
+				cell.push_back({ splineIdx, elementIdx });
+			}
+		}
+	}
+}
+
+void SplineIndex::removeElements(int splineIdx)
+{
+	IndexedSpline& indexed = splines[splineIdx];
+	for (uint64_t key : indexed.cellKeys)
+	{
+		auto cell = cells.find(key);
+		if (cell == cells.end()) { continue; }
+		std::vector<Entry>& entries = cell->second;
+		entries.erase(std::remove_if(entries.begin(), entries.end(), [splineIdx](const Entry& e) { return e.splineIdx == splineIdx; }), entries.end());
+		if (entries.empty()) { cells.erase(cell); }
+	}
+	indexed.cellKeys.clear();
+}
+
+void SplineIndex::getCellRange(float start, float end, int* outFirst, int* outLast) const
+{
+	const float maxCoord = float(ME_MAX_CELL_COORD);
+	*outFirst = (int)getClipped(std::floor(start / cellSize), -maxCoord, maxCoord);
+	*outLast = (int)getClipped(std::floor(end / cellSize), -maxCoord, maxCoord);
+}
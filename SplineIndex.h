@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "Common.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+SplineIndex finds the spline elements near a point without testing all of
+them, for click-selecting on canvases with many splines.
+
+The plane is divided into a uniform grid of square cells, stored sparsely in a
+hash map. Each SplineElement is listed in every cell it passes through, so a
+query only tests the elements listed in the few cells within the query
+distance.
+
+Splines are ordered by when they were added, and elements by their order in
+the spline. A query returns the latest spline with an element within the
+distance, judged by its latest such element, exactly like testing all
+splines & elements from the back.
+
+The index doesn't notice changes of the splines. It keeps the SplineResult it
+indexed, so queries stay consistent while a spline is recomputed; call update()
+after a spline is recreated, e.g. with new ProcessingInput.
+
+See: ArcSpline, SplineElement
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+class ArcSpline;
+struct SplineResult;
+
+// Uniform grid over the elements of ArcSplines, for finding the latest spline near a point.
+class SplineIndex
+{
+public:
+	// Use square cells of the given size; it should be a few times the typical query distance
+	explicit SplineIndex(float cellSize = 32.0f);
+
+	// Add a spline, later than all splines added before
+	void add(ArcSpline* spline);
+
+	// Re-index elements of a spline that was already added, after they changed
+	void update(const ArcSpline* spline);
+
+	// Remove all splines
+	void clear();
+
+	// Find the latest spline with an element within maxDist from the point; null if none. Also note if that element's endpoint is within testDistForEndpoints.
+	ArcSpline* findLatestElementInDistance(const Vector2& point, bool* outIsEndpointHit, float maxDist, float testDistForEndpoints) const;
+
+	// Number of added splines
+	int numSplines() const { return (int)splines.size(); }
+
+protected:
+	// An element listed in a cell: its spline's order of addition & its index in the spline
+	struct Entry
+	{
+		int splineIdx, elementIdx;
+		bool isLaterThan(const Entry& b) const { return splineIdx > b.splineIdx || (splineIdx == b.splineIdx && elementIdx > b.elementIdx); }
+	};
+
+	// An added spline, the result whose elements are indexed & the cells listing them
+	struct IndexedSpline
+	{
+		ref<ArcSpline> spline;
+		ref<const SplineResult> result;
+		std::vector<uint64_t> cellKeys;
+	};
+
+	// List all elements of a spline in the cells they pass through
+	void insertElements(int splineIdx);
+
+	// Remove all entries of a spline from its cells
+	void removeElements(int splineIdx);
+
+	// Range of cells covering a coordinate range
+	void getCellRange(float start, float end, int* outFirst, int* outLast) const;
+
+	// Hash map key of a cell
+	static uint64_t getCellKey(int x, int y) { return (uint64_t)(uint32_t)x << 32 | (uint32_t)y; }
+
+	// Size of the grid cells
+	float cellSize;
+
+	// Non-empty cells
+	std::unordered_map<uint64_t, std::vector<Entry>> cells;
+
+	// Splines in order of addition
+	std::vector<IndexedSpline> splines;
+};
@@ -0,0 +1,145 @@
+#include "FreeformTool.h"
+#include "SplineRecomputer.h"
+
+#include "FreeformLine.h"
+#include "InputQueue.h"
+
+class SplineRecomputer::Token : public CancellationToken
+{
+public:
+	Token(const SplineRecomputer& recomputer, uint64_t generation) : recomputer(recomputer), generation(generation), isLatched(false) { }
+
+	// Once cancelled, stays cancelled: sections skipped earlier can't be taken back when results get too old
+	bool isCancelled() const override
+	{
+		if (isLatched.load(std::memory_order_relaxed)) { return true; }
+		if (recomputer.latestGeneration.load(std::memory_order_relaxed) == generation) { return false; }
+		if (recomputer.maxResultAge <= InputQueue::getTime() - recomputer.resultTime.load(std::memory_order_relaxed)) { return false; }
+		isLatched.store(true, std::memory_order_relaxed);
+		return true;
+	}
+
+private:
+	const SplineRecomputer& recomputer;
+	const uint64_t generation;
+	mutable std::atomic<bool> isLatched;
+};
+
+SplineRecomputer::SplineRecomputer() : isStopping(false), latestGeneration(0), hasRequest(false), doneGeneration(0), resultGeneration(0), resultTime(InputQueue::getTime()), appliedGeneration(0), stats()
+{
+	thread = std::thread(&SplineRecomputer::run, this);
+}
+
+SplineRecomputer::~SplineRecomputer()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		isStopping = true;
+	}
+	wakeCondition.notify_one();
+	thread.join();
+}
+
+uint64_t SplineRecomputer::request(const ref<ArcSpline>& spline, const ArcSplineUtil::ProcessingInput& input)
+{
+	ME_ASSERT(spline);
+
+	// Copy a newly requested spline here, as only this thread changes it
+	ref<ArcSpline> copy;
+	if (requestedSpline != spline)
+	{
+		copy = new ArcSpline(*spline);
+		requestedSpline = spline;
+	}
+
+	uint64_t generation;
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (hasRequest) { stats.numSkipped++; }
+		stats.numRequested++;
+		hasRequest = true;
+		requestSpline = spline;
+		if (copy) { requestCopy = std::move(copy); }
+		requestInput = input;
+		generation = latestGeneration.load(std::memory_order_relaxed) + 1;
+		latestGeneration.store(generation, std::memory_order_relaxed);
+	}
+	wakeCondition.notify_one();
+	return generation;
+}
+
+ArcSpline* SplineRecomputer::applyResult()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	if (resultGeneration <= appliedGeneration) { return nullptr; }
+
+	// Copies into a result the spline recycles, so it doesn't reallocate once its buffers have grown
+	resultSpline->setResult(*result);
+	result = nullptr;
+	appliedGeneration = resultGeneration;
+	ArcSpline* spline = resultSpline;
+	resultSpline = nullptr;
+	return spline;
+}
+
+void SplineRecomputer::waitUntilDone()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	doneCondition.wait(lock, [&]() { return latestGeneration.load(std::memory_order_relaxed) <= doneGeneration; });
+}
+
+SplineRecomputer::Stats SplineRecomputer::getStats() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+void SplineRecomputer::run()
+{
+	// Private copy of the spline being recomputed; keeps its corner & segment caches between requests for the same spline
+	ref<ArcSpline> target, working;
+	ref<ArcSplineUtil::ProcessingInput> workingInput = new ArcSplineUtil::ProcessingInput();
+	for (;;)
+	{
+		// Take the newest request
+		uint64_t generation;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wakeCondition.wait(lock, [&]() { return isStopping || hasRequest; });
+			if (isStopping) { return; }
+			hasRequest = false;
+			generation = latestGeneration.load(std::memory_order_relaxed);
+			*workingInput = requestInput;
+
+			if (requestCopy)
+			{
+				target = requestSpline;
+				working = std::move(requestCopy);
+			}
+			ME_ASSERT(target == requestSpline);
+			requestSpline = nullptr;
+		}
+
+		const Token token(*this, generation);
+		const bool isDone = working->recreateSpline(workingInput, &token);
+
+		// Publish the result, unless a newer one got published meanwhile
+		bool isPublished = false;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!isDone) { stats.numCancelled++; }
+			else if (resultGeneration < generation)
+			{
+				resultSpline = target;
+				result = working->getResult();
+				resultGeneration = generation;
+				resultTime.store(InputQueue::getTime(), std::memory_order_relaxed);
+				stats.numPublished++;
+				isPublished = true;
+			}
+			doneGeneration = generation;
+		}
+		doneCondition.notify_all();
+		if (isPublished && onResult) { onResult(); }
+	}
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "ArcSpline.h"
+#include "ArcSplineUtil.h"
+#include "Common.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+SplineRecomputer recreates splines on its own thread, so scrubbing processing
+parameters, e.g. with TweakUtil, runs at input rate instead of waiting for a
+recompute per mouse event.
+
+Each request() gets the next generation number & replaces any request that's
+still waiting, so a burst of requests costs a single recompute. A recompute
+that's running when a newer request comes is cancelled at its next stage
+boundary, see ArcSpline::recreateSpline(). Only if no result was published for
+maxResultAge, the running one is finished anyway, so results keep showing up
+while requests arrive faster than a recompute takes.
+
+Work happens on a private copy of the spline, taken by request() on the thread
+that owns the spline & handed to the recompute thread with the request. So the
+spline is neither read nor changed by the recompute thread; it's only changed
+by applyResult(), on the thread that owns it. That publishes the newest
+completed result in the spline; results older than one applied before are
+dropped.
+
+See: ArcSpline, TweakUtil
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Thread recreating ArcSplines asynchronously, newest request first, cancelling obsolete work.
+class SplineRecomputer
+{
+public:
+	// Counts of requests & what became of them
+	struct Stats
+	{
+		// Requests, requests replaced before they started, recomputes cancelled & results published
+		uint64_t numRequested, numSkipped, numCancelled, numPublished;
+	};
+
+	// Start the recompute thread
+	SplineRecomputer();
+
+	// Stop & join the recompute thread; pending work is dropped
+	~SplineRecomputer();
+
+	// Recompute the spline with a copy of input, superseding earlier requests; returns the request's generation. The spline's line must not change meanwhile.
+	// Call it on the thread owning the splines; the spline is copied here when it differs from the previously requested one.
+	uint64_t request(const ref<ArcSpline>& spline, const ArcSplineUtil::ProcessingInput& input);
+
+	// Publish the newest completed result in its spline, if it's newer than the last applied one; returns that spline, or null. Call it on the thread owning the splines.
+	ArcSpline* applyResult();
+
+	// Wait until the newest request is completed
+	void waitUntilDone();
+
+	// Statistics so far
+	Stats getStats() const;
+
+	// Generation of the last applied result; 0 if none
+	uint64_t getAppliedGeneration() const { return appliedGeneration; }
+
+	// Seconds without a published result, after which a running recompute is finished even if it's obsolete
+	double maxResultAge = 0.1;
+
+	// Called on the recompute thread when a result is published; set it before requesting
+	std::function<void()> onResult;
+
+private:
+	SplineRecomputer(const SplineRecomputer&) = delete;
+	SplineRecomputer& operator = (const SplineRecomputer&) = delete;
+
+	// Cancels a recompute once a newer request is waiting, unless results got too old
+	class Token;
+
+	// Recompute thread loop
+	void run();
+
+	// Guards all below
+	mutable std::mutex mutex;
+	std::condition_variable wakeCondition, doneCondition;
+	bool isStopping;
+
+	// Generation of the newest request; read by tokens without the mutex
+	std::atomic<uint64_t> latestGeneration;
+
+	// Waiting request; its generation is latestGeneration if hasRequest. A copy of the spline comes with the first request for a spline, else it's null.
+	bool hasRequest;
+	ref<ArcSpline> requestSpline, requestCopy;
+	ArcSplineUtil::ProcessingInput requestInput;
+
+	// Generation of the newest completed or cancelled recompute
+	uint64_t doneGeneration;
+
+	// Newest published result, its spline & generation; generation is 0 if none
+	ref<ArcSpline> resultSpline;
+	ref<const SplineResult> result;
+	uint64_t resultGeneration;
+
+	// When the last result was published, in seconds of InputQueue::getTime(); read by tokens without the mutex
+	std::atomic<double> resultTime;
+
+	// Generation of the last applied result; owner thread only
+	uint64_t appliedGeneration;
+
+	// Spline of the last request; owner thread only
+	ref<ArcSpline> requestedSpline;
+
+	Stats stats;
+	std::thread thread;
+};
@@ -0,0 +1,140 @@
+#include "FreeformTool.h"
+#include "StrokeArchive.h"
+
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include "FreeformLine.h"
+#include "MappedFile.h"
+
+static const char g_archiveMagic[8] = { 'F', 'F', 'S', 'T', 'R', 'O', 'K', 'E' };
+static const uint64_t g_dataAlignment = 16;
+
+StrokeArchive::StrokeArchive(const char* fileName) : file(new MappedFile(fileName)), header(nullptr), index(nullptr)
+{
+	if (!file->isValid() || file->size() < sizeof(Header)) { return; }
+
+	// Check header & index bounds
+	const char* data = static_cast<const char*>(file->data());
+	const uint64_t size = file->size();
+	const Header* h = reinterpret_cast<const Header*>(data);
+	if (0 != std::memcmp(h->magic, g_archiveMagic, sizeof(g_archiveMagic)) || version != h->version) { return; }
+	if (h->indexOffset % alignof(IndexEntry) || size < h->indexOffset || (size - h->indexOffset) / sizeof(IndexEntry) < h->numStrokes) { return; }
+
+	// Check each stroke's data bounds & its ts, so getStroke() can trust the index & lines can search their points
+	const IndexEntry* entries = reinterpret_cast<const IndexEntry*>(data + h->indexOffset);
+	for (uint32_t i = 0; i < h->numStrokes; i++)
+	{
+		const IndexEntry& e = entries[i];
+		const uint64_t dataSize = 3 * sizeof(float) * uint64_t(e.numPoints);
+		if (e.dataOffset % alignof(float) || size < e.dataOffset || size - e.dataOffset < dataSize) { return; }
+		if (e.numPoints == 1 || e.numPoints == 2 || !(ME_EPSILON < e.halfSmoothingSpread)) { return; } // lines have no points, or sentinels & at least one point
+		if (!e.numPoints) { continue; }
+
+		// Sentinels at both ends & sorted ts in between
+		const float* ts = reinterpret_cast<const float*>(data + e.dataOffset);
+		if (-ME_A_LOT != ts[0] || ME_A_LOT != ts[e.numPoints - 1]) { return; }
+		for (uint32_t j = 1; j < e.numPoints; j++) { if (!(ts[j - 1] <= ts[j])) { return; } }
+	}
+
+	header = h;
+	index = entries;
+}
+
+void StrokeArchive::getStroke(int idx, FreeformLine* result) const
+{
+	ME_ASSERT(isValid() && 0 <= idx && idx < numStrokes());
+	const IndexEntry& e = index[idx];
+	const float* ts = reinterpret_cast<const float*>(static_cast<const char*>(file->data()) + e.dataOffset);
+	result->halfSmoothingSpread = e.halfSmoothingSpread;
+	result->setExternalPoints(file, ts, ts + e.numPoints, ts + 2 * e.numPoints, (int)e.numPoints);
+}
+
+void StrokeArchive::getStrokes(std::vector<ref<FreeformLine>>* result) const
+{
+	result->reserve(result->size() + numStrokes());
+	for (int i = 0; i < numStrokes(); i++)
+	{
+		ref<FreeformLine> line = make_ref<FreeformLine>();
+		getStroke(i, line);
+		result->push_back(std::move(line));
+	}
+}
+
+bool StrokeArchive::write(const char* fileName, const std::vector<const FreeformLine*>& lines)
+{
+	// Write a temporary file & replace the old one with it
+	const std::string tempFileName = std::string(fileName) + ".tmp";
+	{
+		std::ofstream stream(tempFileName, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!stream) { return false; }
+
+		// The header is written last, once the index offset is known
+		const Header placeholder = { };
+		stream.write(reinterpret_cast<const char*>(&placeholder), sizeof(placeholder));
+		std::vector<IndexEntry> entries;
+		const uint64_t indexOffset = writeStrokes(stream, sizeof(Header), lines, &entries);
+		if (!writeIndexAndHeader(stream, indexOffset, entries)) { return false; }
+	}
+
+	return MappedFile::replace(fileName, tempFileName.c_str());
+}
+
+bool StrokeArchive::append(const char* fileName, const std::vector<const FreeformLine*>& lines)
+{
+	// Validate the archive & copy its index; the mapping is released before writing
+	std::vector<IndexEntry> entries;
+	{
+		const StrokeArchive archive(fileName);
+		if (!archive.isValid()) { return false; }
+		entries.assign(archive.index, archive.index + archive.numStrokes());
+	}
+
+	std::fstream stream(fileName, std::ios::in | std::ios::out | std::ios::binary);
+	if (!stream || !stream.seekp(0, std::ios::end)) { return false; }
+
+	// New data & the new index go past the end of the file, so the old header stays valid until they are flushed
+	const uint64_t endOffset = (uint64_t)stream.tellp();
+	const uint64_t indexOffset = writeStrokes(stream, endOffset, lines, &entries);
+	return writeIndexAndHeader(stream, indexOffset, entries);
+}
+
+uint64_t StrokeArchive::writeStrokes(std::ostream& stream, uint64_t offset, const std::vector<const FreeformLine*>& lines, std::vector<IndexEntry>* index)
+{
+	static const char padding[g_dataAlignment] = { };
+	for (const FreeformLine* line : lines)
+	{
+		// Align each stroke, so float arrays can be used in place
+		const uint64_t numPadding = (g_dataAlignment - offset % g_dataAlignment) % g_dataAlignment;
+		stream.write(padding, numPadding);
+		offset += numPadding;
+
+		const uint32_t numPoints = (uint32_t)line->numPoints();
+		index->push_back(IndexEntry{ offset, numPoints, line->halfSmoothingSpread });
+		stream.write(reinterpret_cast<const char*>(line->pointTs), numPoints * sizeof(float));
+		stream.write(reinterpret_cast<const char*>(line->pointXs), numPoints * sizeof(float));
+		stream.write(reinterpret_cast<const char*>(line->pointYs), numPoints * sizeof(float));
+		offset += 3 * sizeof(float) * uint64_t(numPoints);
+	}
+
+	// Align the index
+	const uint64_t numPadding = (alignof(IndexEntry) - offset % alignof(IndexEntry)) % alignof(IndexEntry);
+	stream.write(padding, numPadding);
+	return offset + numPadding;
+}
+
+bool StrokeArchive::writeIndexAndHeader(std::ostream& stream, uint64_t offset, const std::vector<IndexEntry>& index)
+{
+	stream.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry));
+	if (!stream.flush()) { return false; }
+
+	Header h;
+	std::memcpy(h.magic, g_archiveMagic, sizeof(g_archiveMagic));
+	h.version = version;
+	h.numStrokes = (uint32_t)index.size();
+	h.indexOffset = offset;
+	stream.seekp(0);
+	stream.write(reinterpret_cast<const char*>(&h), sizeof(h));
+	return (bool)stream.flush();
+}
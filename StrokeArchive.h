@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+#include "Common.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+StrokeArchive is a versioned binary container for a collection of FreeformLines.
+
+Layout, all values in native byte order; files of the other byte order are
+rejected, as their version doesn't match:
+  Header      magic "FFSTROKE", version, number of strokes, offset of the index
+  Data        for each stroke, 16-byte aligned: t, x & y float arrays, each with
+              all stored points including the sentinels
+  Index       for each stroke: offset of its data, number of points &
+              halfSmoothingSpread
+
+The file is memory mapped for reading, and FreeformLines taken from the archive
+use the mapped arrays directly, so loading only checks the index & the t values
+of each stroke; no points are copied. The lines keep the mapping alive on their
+own.
+
+New strokes can be appended. Their data & the new index are written past the
+end of the file, and the header is updated last, once they are flushed; until
+then the file is still the old archive. The old index is left as unused space.
+Data of existing strokes never moves, so lines taken from the archive stay
+valid, but an open StrokeArchive must not be used after appending to its file.
+
+See: FreeformLine, MappedFile
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+class FreeformLine;
+class MappedFile;
+
+// Binary file of FreeformLines, read through a memory mapping without copying.
+class StrokeArchive
+{
+public:
+	// Map & validate the archive; check isValid() for success. Fails for text files written with FreeformLine's stream operators.
+	explicit StrokeArchive(const char* fileName);
+
+	// Was the file mapped & is it a supported archive
+	bool isValid() const { return nullptr != header; }
+
+	// Number of stored strokes
+	int numStrokes() const { return isValid() ? (int)header->numStrokes : 0; }
+
+	// Make the line view the stored stroke at idx; no points are copied
+	void getStroke(int idx, FreeformLine* result) const;
+
+	// Append all stored strokes to result, in stored order
+	void getStrokes(std::vector<ref<FreeformLine>>* result) const;
+
+	// Write lines into a new archive, replacing the file. The old file is moved aside & removed rather than overwritten, so lines mapped from it stay valid.
+	static bool write(const char* fileName, const std::vector<const FreeformLine*>& lines);
+
+	// Append lines to an existing archive; returns false without writing anything if the file is missing or not an archive, so the caller can write all lines
+	static bool append(const char* fileName, const std::vector<const FreeformLine*>& lines);
+
+	// Current format version
+	static const uint32_t version = 1;
+
+private:
+	// File header
+	struct Header
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t numStrokes;
+		uint64_t indexOffset;
+	};
+
+	// Index entry of a single stroke
+	struct IndexEntry
+	{
+		uint64_t dataOffset;
+		uint32_t numPoints;
+		float halfSmoothingSpread;
+	};
+
+	// Write stroke data at offset & add an index entry for each line; returns the offset past the data
+	static uint64_t writeStrokes(std::ostream& stream, uint64_t offset, const std::vector<const FreeformLine*>& lines, std::vector<IndexEntry>* index);
+
+	// Write & flush the index at offset, then the header; returns false if writing failed
+	static bool writeIndexAndHeader(std::ostream& stream, uint64_t offset, const std::vector<IndexEntry>& index);
+
+	// Mapped file, shared with lines viewing its strokes
+	std::shared_ptr<const MappedFile> file;
+
+	// Header & index within the mapped file; null if the file is not valid
+	const Header* header;
+	const IndexEntry* index;
+};
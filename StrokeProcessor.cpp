@@ -0,0 +1,109 @@
+#include "FreeformTool.h"
+#include "StrokeProcessor.h"
+
+#include <algorithm>
+#include <vector>
+
+StrokeProcessor::StrokeProcessor(int queueCapacity) : queue(queueCapacity), isWaiting(false), isStopping(false), numProcessed(0), stats()
+{
+	thread = std::thread(&StrokeProcessor::run, this);
+}
+
+StrokeProcessor::~StrokeProcessor()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		isStopping = true;
+	}
+	wakeCondition.notify_one();
+	thread.join();
+}
+
+void StrokeProcessor::beginStroke(const ref<FreeformLine>& line, const ref<ArcSpline>& liveSpline)
+{
+	// The processing thread is idle between strokes, so this doesn't wait
+	std::lock_guard<std::mutex> lock(dataMutex);
+	ME_ASSERT(!this->line);
+	this->line = line;
+	this->liveSpline = liveSpline;
+}
+
+bool StrokeProcessor::addPoint(const Vector2& point, double time)
+{
+	if (!queue.push(InputPoint{ point, time })) { return false; }
+
+	// The processing thread checks the queue after setting isWaiting, so one of both sides sees the other's write
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (isWaiting.load(std::memory_order_relaxed))
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		wakeCondition.notify_one();
+	}
+	return true;
+}
+
+void StrokeProcessor::endStroke()
+{
+	const uint64_t numQueued = queue.getStats().numPushed;
+	{
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		processedCondition.wait(lock, [&]() { return numQueued <= numProcessed; });
+	}
+	std::lock_guard<std::mutex> lock(dataMutex);
+	line = nullptr;
+	liveSpline = nullptr;
+}
+
+StrokeProcessor::Stats StrokeProcessor::getStats() const
+{
+	std::lock_guard<std::mutex> lock(wakeMutex);
+	Stats result = stats;
+	result.queue = queue.getStats();
+	return result;
+}
+
+void StrokeProcessor::run()
+{
+	std::vector<InputPoint> batch;
+	for (;;)
+	{
+		// Sleep until points are queued
+		{
+			std::unique_lock<std::mutex> lock(wakeMutex);
+			isWaiting.store(true, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			wakeCondition.wait(lock, [&]() { return isStopping || !queue.isEmpty(); });
+			isWaiting.store(false, std::memory_order_relaxed);
+			if (isStopping) { return; }
+		}
+
+		// Take all queued points, add them & update the spline once
+		batch.clear();
+		InputPoint inputPoint;
+		while (queue.pop(&inputPoint)) { batch.push_back(inputPoint); }
+		ref<ArcSpline> spline;
+		{
+			std::lock_guard<std::mutex> lock(dataMutex);
+			if (line)
+			{
+				for (const InputPoint& p : batch) { line->addPoint(p.point); }
+				spline = liveSpline;
+			}
+		}
+
+		// Without the lock: the spline only reads the line, which changes on this thread only, and publishes snapshots
+		if (spline) { spline->updateLiveSpline(); }
+
+		// Points are processed once the spline shows them
+		const double now = InputQueue::getTime();
+		{
+			std::lock_guard<std::mutex> lock(wakeMutex);
+			numProcessed += batch.size();
+			stats.numBatches++;
+			stats.maxBatchSize = std::max(stats.maxBatchSize, (int)batch.size());
+			stats.maxLatency = std::max(stats.maxLatency, now - batch.front().time);
+		}
+		processedCondition.notify_all();
+		if (onUpdate) { onUpdate(); }
+	}
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "ArcSpline.h"
+#include "Common.h"
+#include "FreeformLine.h"
+#include "InputQueue.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+StrokeProcessor grows the line being drawn on its own thread, so capturing
+input never waits for spline work.
+
+The capturing thread, e.g. the UI thread, only pushes timestamped points into
+an InputQueue. The processing thread owns the line while the stroke lasts: it
+takes all points queued so far, adds them to the line & updates the live
+spline once per batch. While an update runs, new points pile up in the queue
+& make the next batch bigger, so a slow update delays the spline instead of
+the input.
+
+Points are added to the line under getMutex(); other threads hold it while
+reading the line's points, e.g. for drawing. The live spline is updated after
+the lock is released: it only reads the line, which changes on this thread
+only, and publishes SplineResult snapshots, so drawing it needs no lock. The
+capturing thread never takes that lock for points.
+
+Backpressure shows in getStats(): points dropped by a full queue, the deepest
+queue, the biggest batch & the longest delay from capture to update.
+
+See: InputQueue, FreeformLine, ArcSpline::updateLiveSpline
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Processing thread growing a FreeformLine & its live ArcSpline from queued input points.
+class StrokeProcessor
+{
+public:
+	// Backpressure statistics
+	struct Stats
+	{
+		// Queued & dropped points
+		InputQueue::Stats queue;
+
+		// Number of batches, i.e. live spline updates
+		uint64_t numBatches;
+
+		// Most points added in one batch; big batches mean processing lagged behind input
+		int maxBatchSize;
+
+		// Longest time from capturing a point to adding it & updating the spline, in seconds
+		double maxLatency;
+	};
+
+	// Start the processing thread
+	explicit StrokeProcessor(int queueCapacity = 4096);
+
+	// Stop & join the processing thread; queued points are dropped
+	~StrokeProcessor();
+
+	// Start adding queued points to a line, and updating its live spline if it's not null. The previous stroke must be ended.
+	void beginStroke(const ref<FreeformLine>& line, const ref<ArcSpline>& liveSpline);
+
+	// Queue a point of the stroke, captured at time from InputQueue::getTime(); never blocks. Returns false if the queue is full & the point is dropped.
+	bool addPoint(const Vector2& point, double time);
+
+	// Wait until all queued points are added, then release the line & spline
+	void endStroke();
+
+	// Held while points are added to the line; lock it while reading the line's points on other threads
+	std::mutex& getMutex() { return dataMutex; }
+
+	// Statistics so far
+	Stats getStats() const;
+
+	// Called on the processing thread after each batch, without the lock held; set it before queuing points
+	std::function<void()> onUpdate;
+
+private:
+	StrokeProcessor(const StrokeProcessor&) = delete;
+	StrokeProcessor& operator = (const StrokeProcessor&) = delete;
+
+	// Processing thread loop
+	void run();
+
+	// Points from the capturing thread
+	InputQueue queue;
+
+	// Line & spline of the current stroke; the references are guarded by dataMutex
+	std::mutex dataMutex;
+	ref<FreeformLine> line;
+	ref<ArcSpline> liveSpline;
+
+	// Wakes the processing thread when points are queued, and endStroke() when they're processed
+	mutable std::mutex wakeMutex;
+	std::condition_variable wakeCondition, processedCondition;
+
+	// Is the processing thread waiting on wakeCondition; lets addPoint() skip the mutex while it's busy
+	std::atomic<bool> isWaiting;
+
+	// Guarded by wakeMutex
+	bool isStopping;
+	uint64_t numProcessed;
+	Stats stats;
+
+	std::thread thread;
+};
@@ -0,0 +1,43 @@
+#include "FreeformTool.h"
+#include "StrokePyramid.h"
+
+#include <cmath>
+
+#include "FreeformLine.h"
+
+void StrokePyramid::build(const FreeformLine& line, const Range& range, float baseSpacing, int maxLevels)
+{
+	ME_ASSERT(ME_EPSILON < baseSpacing && 0 < maxLevels);
+	ME_ASSERT(range.isValid() && range.length() < ME_A_LOT);
+	this->range = range;
+	xs.clear(); ys.clear(); levels.clear();
+
+	// Resample the line into level 0; its last point is at or past the range end. Coarser levels together hold at most as many points.
+	const int numBasePoints = std::max(2, int(std::ceil(range.length() / baseSpacing)) + 1);
+	xs.reserve(2 * numBasePoints + maxLevels);
+	ys.reserve(2 * numBasePoints + maxLevels);
+	FreeformLine::Cursor cursor(line);
+	for (int i = 0; i < numBasePoints; i++)
+	{
+		const Vector2 p = cursor.getPointAt(range.start + float(i) * baseSpacing);
+		xs.push_back(p.x);
+		ys.push_back(p.y);
+	}
+	levels.push_back(Level{ baseSpacing, 1.0f / baseSpacing, 0, numBasePoints });
+
+	// Each coarser level keeps every other point of the one below. If that leaves the range end uncovered, one more point is sampled from the line.
+	while (numLevels() < maxLevels)
+	{
+		const Level fine = levels.back();
+		const int numPoints = fine.numPoints / 2 + 1;
+		if (numPoints < 3) { break; }
+		for (int i = 0; i < numPoints; i++)
+		{
+			const int fineIdx = 2 * i;
+			const Vector2 p = fineIdx < fine.numPoints ? getPoint(numLevels() - 1, fineIdx) : line.getPointAt(range.start + float(fineIdx) * fine.spacing);
+			xs.push_back(p.x);
+			ys.push_back(p.y);
+		}
+		levels.push_back(Level{ 2.0f * fine.spacing, 0.5f * fine.invSpacing, fine.firstPoint + fine.numPoints, numPoints });
+	}
+}
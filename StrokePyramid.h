@@ -0,0 +1,84 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "Common.h"
+#include "MonotonicArena.h"
+#include "Vector2.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+StrokePyramid is a level-of-detail pyramid of a FreeformLine section: the
+section resampled into polylines at uniform arc-length spacings, doubling from
+level to level. Level 0 samples the line every baseSpacing, and each coarser
+level keeps every other point of the level below, so the points of all levels
+lie exactly on the line.
+
+Scanning a coarse level costs length / spacing no matter how densely the
+input was sampled, so code can look at the whole section coarsely first, and
+refine only where something interesting happens. findCorners() does that to
+skip straight & gently curved parts of long strokes.
+
+Points past the end of the line repeat its last point, same as
+FreeformLine::getPointAt().
+
+See: FreeformLine, ArcSplineUtil::findCorners
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+class FreeformLine;
+
+// A FreeformLine section resampled at power-of-two multiples of a base spacing.
+class StrokePyramid
+{
+public:
+	// Create an empty pyramid; points come from the arena, or from the heap if it's null
+	explicit StrokePyramid(MonotonicArena* arena = nullptr) : xs(arena), ys(arena), levels(arena) { }
+
+	// Resample the line within range at baseSpacing, then build up to maxLevels levels, stopping at a level with less than 3 points. Spacing must be greater than epsilon.
+	void build(const FreeformLine& line, const Range& range, float baseSpacing, int maxLevels);
+
+	// Number of levels; 0 if not built
+	int numLevels() const { return (int)levels.size(); }
+
+	// Resampled range; level points start at its start
+	const Range& getRange() const { return range; }
+
+	// Distance between consecutive points of a level
+	float getSpacing(int level) const { return levels[level].spacing; }
+
+	// Number of points of a level; the last one is at or past the range end
+	int numPoints(int level) const { return levels[level].numPoints; }
+
+	// Point of a level at getRange().start + idx * getSpacing(level)
+	Vector2 getPoint(int level, int idx) const { const Level& l = levels[level]; return Vector2(xs[l.firstPoint + idx], ys[l.firstPoint + idx]); }
+
+	// Approximate point on the line at 't', interpolated between the points of a level
+	inline Vector2 getPointAt(int level, float t) const;
+
+private:
+	// A level's spacing & its points within xs & ys
+	struct Level
+	{
+		float spacing, invSpacing;
+		int firstPoint, numPoints;
+	};
+
+	// Resampled range
+	Range range;
+
+	// Point coordinates of all levels, from the finest level to the coarsest
+	ArenaVector<float> xs, ys;
+
+	// Levels from the finest to the coarsest
+	ArenaVector<Level> levels;
+};
+
+
+Vector2 StrokePyramid::getPointAt(int level, float t) const
+{
+	const Level& l = levels[level];
+	const float x = getClipped((t - range.start) * l.invSpacing, 0.0f, float(l.numPoints - 1));
+	const int idx = std::min(int(x), l.numPoints - 2);
+	const float frac = x - float(idx);
+	return Vector2::interpolate(getPoint(level, idx), getPoint(level, idx + 1), frac);
+}
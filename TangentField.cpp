@@ -0,0 +1,38 @@
+#include "FreeformTool.h"
+#include "TangentField.h"
+
+#include <cmath>
+
+#include "FreeformLineSection.h"
+
+void TangentField::build(const FreeformLineSection& section, float resolution)
+{
+	build(section, resolution, Range(-ME_A_LOT, ME_A_LOT));
+}
+
+void TangentField::build(const FreeformLineSection& section, float resolution, const Range& window)
+{
+	ME_ASSERT(ME_EPSILON < resolution);
+	ME_ASSERT(section.getBounds().isValid() && section.getBounds().length() < ME_A_LOT);
+
+	// Clipped sampling points stop moving outside this range; see FreeformLineSection::getTangentAt(). Far outside, both are clipped exactly.
+	sampledRange = section.getTangentVaryingRange();
+	startTangent = section.getTangentAt(-ME_A_LOT);
+	endTangent = section.getTangentAt(ME_A_LOT);
+	gridStart = section.getBounds().start;
+	this->resolution = resolution;
+	invResolution = 1.0f / resolution;
+
+	// Cover the range, or the window within it, with grid points; the first & last may fall outside, where the tangent is frozen anyway
+	const float windowStart = (getClipped(window.start, sampledRange.start, sampledRange.end) - gridStart) * invResolution;
+	const float windowEnd = (getClipped(window.end, sampledRange.start, sampledRange.end) - gridStart) * invResolution;
+	firstSampleIdx = int(std::floor(windowStart));
+	const int endSampleIdx = int(std::floor(windowEnd)) + 2;
+	samples.clear();
+	samples.reserve(endSampleIdx - firstSampleIdx);
+	FreeformLineSection::Cursor cursor(section);
+	for (int i = firstSampleIdx; i < endSampleIdx; i++)
+	{
+		samples.push_back(cursor.getTangentAt(gridStart + float(i) * resolution));
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "Common.h"
+#include "Instrumentation.h"
+#include "MonotonicArena.h"
+#include "Vector2.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+TangentField stores the smoothed tangents of a FreeformLine, sampled once at a
+fixed resolution within a section's clipping bounds. Corner detection queries
+four overlapping tangents per step, and each FreeformLineSection::getTangentAt() costs
+two point lookups. Reading the field instead costs one array access.
+
+Only the range where the clipped tangent actually varies is sampled. Outside
+of it, FreeformLineSection::getTangentAt() returns frozen end tangents, and so does
+the field, exactly. The sampling grid starts at the section's start, like the
+steps of corner detection, so their queries land on it even where the varying
+range doesn't, e.g. on sections shorter than 2 * halfSmoothingSpread. Queries
+that land on the grid return the sampled tangent unchanged; queries in between
+are interpolated.
+
+A field can also be built for a window of queries only, e.g. around corner
+candidates. It samples the same grid as the full field, so its tangents are
+identical within the window.
+
+See: FreeformLine, FreeformLineSection
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+class FreeformLineSection;
+
+// Smoothed tangents of a FreeformLine sampled within its clipping bounds.
+class TangentField
+{
+public:
+	// Create an empty field; samples come from the arena, or from the heap if it's null
+	explicit TangentField(MonotonicArena* arena = nullptr) : gridStart(0.0f), resolution(0.0f), invResolution(0.0f), firstSampleIdx(0), samples(arena) { }
+
+	// Sample tangents of the line section within its bounds, spaced by resolution. Resolution must be greater than epsilon.
+	void build(const FreeformLineSection& section, float resolution);
+
+	// Sample only the tangents needed for queries within the window; queries outside of it aren't allowed
+	void build(const FreeformLineSection& section, float resolution, const Range& window);
+
+	// Release samples & mark the field invalid
+	void clear() { samples.clear(); }
+
+	// Has the field been built
+	bool isValid() const { return !samples.empty(); }
+
+	// Range of 't' where the tangent varies; tangents are frozen outside of it
+	const Range& getSampledRange() const { return sampledRange; }
+
+	// Approximate smoothed tangent at 't' distance from the line's start; matches FreeformLineSection::getTangentAt() on sampling grid points
+	inline Vector2 getTangentAt(float t) const;
+
+private:
+	// Range of 't' where the tangent varies
+	Range sampledRange;
+
+	// Frozen tangents before & after sampledRange
+	Vector2 startTangent, endTangent;
+
+	// Start of the sampling grid, i.e. of the section
+	float gridStart;
+
+	// Distance between consecutive samples & its inverse
+	float resolution, invResolution;
+
+	// Grid index of the first stored sample
+	int firstSampleIdx;
+
+	// Tangent samples from firstSampleIdx on, covering sampledRange or the window within it
+	ArenaVector<Vector2> samples;
+};
+
+
+Vector2 TangentField::getTangentAt(float t) const
+{
+	ME_ASSERT(isValid());
+	ME_COUNT(COUNTER_GET_TANGENT_AT);
+	if (t <= sampledRange.start) { return startTangent; }
+	if (sampledRange.end <= t) { return endTangent; }
+	const float x = (t - gridStart) * invResolution;
+	const int gridIdx = int(std::floor(x));
+	const float frac = x - float(gridIdx);
+	const int idx = gridIdx - firstSampleIdx;
+	ME_ASSERT(0 <= idx && idx < int(samples.size()));
+	if (idx + 1 >= int(samples.size())) { return samples.back(); }
+	return frac > 0.0f ? Vector2::interpolate(samples[idx], samples[idx + 1], frac).normalized() : samples[idx];
+}
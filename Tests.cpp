@@ -0,0 +1,351 @@
+#include "FreeformTool.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "ArcSpline.h"
+#include "ArcSplineUtil.h"
+#include "Common.h"
+#include "FreeformLine.h"
+#include "FreeformLineSection.h"
+#include "Geometry.h"
+#include "InputQueue.h"
+#include "SplineCache.h"
+#include "StrokeArchive.h"
+#include "StrokeProcessor.h"
+#include "TangentField.h"
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+These are the checks of the engine's invariants, run by ctest.
+
+Each check compares a fast path against a direct reference on synthetic
+strokes, which are generated deterministically. A failed comparison is printed
+& the process exits with 1.
+
+Run with a check's name to run only checks whose name contains it.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Number of failed comparisons of the running check
+static int g_numFailures;
+
+// Note a failed comparison, unless cond holds
+static void expect(bool cond, const char* what)
+{
+	if (cond) { return; }
+	std::printf("  failed: %s\n", what);
+	g_numFailures++;
+}
+
+// Generate a deterministic mouse-like stroke of input points
+static std::vector<Vector2> generateStroke(int numPoints, unsigned int seed)
+{
+	unsigned int state = seed;
+	auto random = [&state]() { state = state * 1103515245u + 12345u; return float((state >> 16) & 0x7fff) / 32768.0f; };
+
+	std::vector<Vector2> points;
+	Vector2 point(500.0f, 500.0f);
+	float heading = 0.0f, turnRate = 0.0f;
+	while ((int)points.size() < numPoints)
+	{
+		// Curve gently, turn sharply now & then, and snap to the pixel grid
+		if (random() < 0.01f) { heading += (random() < 0.5f ? -1.0f : 1.0f) * (1.2f + random()); }
+		turnRate = getClipped(turnRate + 0.02f * (random() - 0.5f), -0.1f, 0.1f);
+		heading += turnRate;
+		point += Vector2(std::cos(heading), std::sin(heading)) * (1.0f + 2.0f * random());
+		points.push_back(Vector2(std::floor(point.x + 0.5f), std::floor(point.y + 0.5f)));
+	}
+	return points;
+}
+
+// Create a line of the points
+static ref<FreeformLine> makeLine(const std::vector<Vector2>& points)
+{
+	ref<FreeformLine> line = make_ref<FreeformLine>();
+	for (const Vector2& p : points) { line->addPoint(p); }
+	return line;
+}
+
+// Check if two lines store the same points at the same ts
+static bool hasSamePoints(const FreeformLine& a, const FreeformLine& b)
+{
+	if (a.numPoints() != b.numPoints() || a.length() != b.length()) { return false; }
+	for (int i = 0; i < a.numPoints(); i++)
+	{
+		if (a.getInputPoint(i).x != b.getInputPoint(i).x || a.getInputPoint(i).y != b.getInputPoint(i).y) { return false; }
+	}
+	return true;
+}
+
+// Point on the line at 't', by a linear search over the stored points; the reference of FreeformLine::getPointAt()
+static Vector2 getPointAtByLinearSearch(const FreeformLine& line, float t)
+{
+	// Stored ts, recomputed as addPoint() does without decimation; sentinels at both ends
+	std::vector<float> ts(1, -ME_A_LOT);
+	for (int i = 1; i < line.numPoints() - 1; i++) { ts.push_back(1 == i ? 0.0f : ts.back() + line.getInputPoint(i - 1).distTo(line.getInputPoint(i))); }
+	ts.push_back(ME_A_LOT);
+
+	int idx = 0;
+	while (idx + 2 < line.numPoints() && ts[idx + 1] <= t) { idx++; }
+	const float localT = (t - ts[idx]) / (ts[idx + 1] - ts[idx]);
+	return Vector2::interpolate(line.getInputPoint(idx), line.getInputPoint(idx + 1), localT);
+}
+
+// Mean squared distance of the line's points within bounds to a fitting line, by a fine midpoint sum; the reference of integrated moments
+static float calcMeanSquaredDistBySum(const FreeformLine& line, const Range& bounds, const Line& fitLine)
+{
+	const int numSteps = 20000;
+	const double step = double(bounds.length()) / numSteps;
+	double sum = 0.0;
+	for (int i = 0; i < numSteps; i++)
+	{
+		const float dist = fitLine.signedDistTo(line.getPointAt(float(bounds.start + (i + 0.5) * step)));
+		sum += double(dist) * dist;
+	}
+	return float(sum / numSteps);
+}
+
+// FreeformLine::getPointAt() & Cursor match a linear search over the points, before, on & after the line
+static void checkPointQueries()
+{
+	for (int numPoints : { 1, 2, 5, 400 })
+	{
+		const ref<FreeformLine> line = makeLine(generateStroke(numPoints, 11u + numPoints));
+		bool isLineExact = true, isCursorExact = true;
+		FreeformLine::Cursor cursor(*line);
+		for (float t = -5.0f; t <= line->length() + 5.0f; t += 0.37f)
+		{
+			const Vector2 expected = getPointAtByLinearSearch(*line, t);
+			if (line->getPointAt(t) != expected) { isLineExact = false; }
+			if (cursor.getPointAt(t) != expected) { isCursorExact = false; }
+		}
+
+		// Jump back & forth
+		for (int i = 0; i < 200; i++)
+		{
+			const float t = std::fmod(float(i) * 37.7f, line->length() + 1.0f);
+			if (cursor.getPointAt(t) != getPointAtByLinearSearch(*line, t)) { isCursorExact = false; }
+		}
+		expect(isLineExact, "getPointAt() matches the linear search");
+		expect(isCursorExact, "Cursor::getPointAt() matches the linear search");
+	}
+}
+
+// ArcSplineUtil::isSegment() with moments measures the integrated error of the section, as a direct sum does
+static void checkMomentSegments()
+{
+	const ref<FreeformLine> line = makeLine(generateStroke(2000, 5u));
+	line->setMomentsKept(true);
+	const ArcSplineUtil::SegmentsInput input;
+	int numDifferent = 0, numDifferentDecisions = 0;
+	for (int i = 0; i < 200; i++)
+	{
+		const float start = std::fmod(float(i) * 71.3f, line->length() - 1.0f);
+		const Range bounds(start, std::fmin(start + 1.0f + float(i % 20) * 9.7f, line->length()));
+		float meanError2;
+		const bool isSegment = ArcSplineUtil::isSegment(*line, bounds, input, &meanError2);
+
+		const Vector2 p0 = line->getPointAt(bounds.start);
+		const Vector2 p1 = line->getPointAt(bounds.end);
+		const float expected = calcMeanSquaredDistBySum(*line, bounds, Line::between(p0, p1));
+		if (1e-3f * expected + 1e-4f < std::fabs(meanError2 - expected)) { numDifferent++; }
+
+		// Decisions agree, unless the error is within the tolerance of the limit
+		const float limit = input.maxMeanErrorAtReferenceLength * input.maxMeanErrorAtReferenceLength * p0.distTo(p1) / input.referenceSegmentLength;
+		if (1e-3f * limit + 1e-4f < std::fabs(expected - limit) && isSegment != (expected <= limit)) { numDifferentDecisions++; }
+	}
+	expect(0 == numDifferent, "moment errors match the direct sum");
+	expect(0 == numDifferentDecisions, "moment segment decisions match the direct sum");
+}
+
+// Lines written & appended to a StrokeArchive come back with the same points
+static void checkStrokeArchive()
+{
+	const char* fileName = "FreeformTests.strokes";
+	std::vector<ref<FreeformLine>> lines = { makeLine(generateStroke(300, 1u)), make_ref<FreeformLine>(), makeLine(generateStroke(1, 2u)), makeLine(generateStroke(50, 3u)) };
+	lines[3]->halfSmoothingSpread = 4.5f;
+	ref<FreeformLine> decimated = make_ref<FreeformLine>();
+	decimated->decimationTolerance = 0.5f;
+	for (const Vector2& p : generateStroke(500, 4u)) { decimated->addPoint(p); }
+	lines.push_back(decimated);
+
+	expect(StrokeArchive::write(fileName, { lines[0], lines[1], lines[2] }), "archive is written");
+	expect(StrokeArchive::append(fileName, { lines[3], lines[4] }), "archive is appended to");
+	{
+		const StrokeArchive archive(fileName);
+		expect(archive.isValid() && archive.numStrokes() == (int)lines.size(), "archive has all strokes");
+		for (int i = 0; archive.isValid() && i < archive.numStrokes() && i < (int)lines.size(); i++)
+		{
+			FreeformLine line;
+			archive.getStroke(i, &line);
+			expect(hasSamePoints(line, *lines[i]) && line.halfSmoothingSpread == lines[i]->halfSmoothingSpread, "stored stroke matches its line");
+		}
+	}
+	std::remove(fileName);
+
+	// Text files aren't archives & aren't appended to
+	{
+		std::FILE* file = std::fopen(fileName, "w");
+		std::fputs("not an archive\n", file);
+		std::fclose(file);
+	}
+	expect(!StrokeArchive(fileName).isValid() && !StrokeArchive::append(fileName, { lines[0] }), "text file is rejected");
+	std::remove(fileName);
+}
+
+// Do two files have the same contents
+static bool hasSameBytes(const char* fileName, const char* otherFileName)
+{
+	std::FILE* file = std::fopen(fileName, "rb");
+	std::FILE* otherFile = std::fopen(otherFileName, "rb");
+	bool isSame = file && otherFile;
+	while (isSame)
+	{
+		const int c = std::fgetc(file);
+		isSame = c == std::fgetc(otherFile);
+		if (EOF == c) { break; }
+	}
+	if (file) { std::fclose(file); }
+	if (otherFile) { std::fclose(otherFile); }
+	return isSame;
+}
+
+// Results written to a SplineCache come back with their settings, also for identical strokes with different settings
+static void checkSplineCache()
+{
+	const char* fileName = "FreeformTests.splines";
+	const std::vector<Vector2> points = generateStroke(800, 9u);
+	ArcSplineUtil::ProcessingInput tweaked;
+	tweaked.segments.maxMeanErrorAtReferenceLength *= 3.0f;
+	const std::vector<ref<ArcSpline>> splines =
+	{
+		make_ref<ArcSpline>(makeLine(points)),
+		make_ref<ArcSpline>(makeLine(points), new ArcSplineUtil::ProcessingInput(tweaked)),
+		make_ref<ArcSpline>(makeLine(generateStroke(300, 10u))),
+	};
+	expect(SplineCache::write(fileName, splines), "cache is written");
+
+	const SplineCache cache(fileName);
+	expect(cache.isValid() && cache.numEntries() == (int)splines.size(), "cache has all results");
+	for (int i = 0; i < (int)splines.size(); i++)
+	{
+		const ArcSpline& spline = *splines[i];
+		ArcSplineUtil::ProcessingInput input;
+		SplineResult result;
+		const bool isFound = cache.find(*spline.sourceLine, i, false, &input, &result);
+		expect(isFound && SplineCache::hashInput(input) == SplineCache::hashInput(*spline.processingInput), "stored settings come back");
+
+		const ref<const SplineResult> expected = spline.getResult();
+		bool isSame = isFound && result.displayShapes.size() == expected->displayShapes.size() && result.debugCorners == expected->debugCorners;
+		for (size_t j = 0; isSame && j < result.displayShapes.size(); j++)
+		{
+			const SplineElement& a = result.displayShapes[j];
+			const SplineElement& b = expected->displayShapes[j];
+			isSame = a.type == b.type && a.idxInBiarc == b.idxInBiarc && a.p0 == b.p0 && a.p1 == b.p1 && a.circle.center() == b.circle.center() && a.circle.radius == b.circle.radius
+				&& a.startAngle == b.startAngle && a.sweepAngle == b.sweepAngle;
+		}
+		expect(isSame, "stored result matches the spline's");
+	}
+
+	// The stroke stored with different settings is ambiguous at other indices, but found when its input is matched
+	ArcSplineUtil::ProcessingInput input = tweaked;
+	SplineResult result;
+	expect(!cache.find(*splines[0]->sourceLine, 7, false, &input, &result), "ambiguous stroke isn't found");
+	expect(cache.find(*splines[0]->sourceLine, 7, true, &input, &result), "stroke is found by its input");
+
+	// Writing the same results again gives the same file
+	const char* otherFileName = "FreeformTests2.splines";
+	expect(SplineCache::write(otherFileName, splines) && hasSameBytes(fileName, otherFileName), "cache is written deterministically");
+	std::remove(otherFileName);
+	std::remove(fileName);
+}
+
+// TangentField returns the section's tangents exactly on the grid from the section's start, also on sections shorter than 2 * halfSmoothingSpread
+static void checkTangentField()
+{
+	const ref<FreeformLine> line = makeLine(generateStroke(200, 3u));
+	for (float start : { 0.0f, 17.25f, 100.5f })
+	{
+		for (float length : { 3.7f, 12.3f, 19.9f, 20.0f, 33.3f, 150.0f })
+		{
+			const FreeformLineSection section(*line, Range(start, std::fmin(start + length, line->length())));
+			TangentField window;
+			window.build(section, line->tangentFieldResolution, Range(start + 2.0f, start + 9.0f));
+			bool isFieldExact = true, isWindowExact = true;
+			for (float t = start - 30.0f; t <= start + length + 30.0f; t += 1.0f)
+			{
+				const Vector2 expected = section.getTangentAt(t);
+				if (section.getTangentField().getTangentAt(t) != expected) { isFieldExact = false; }
+				if (start + 2.0f <= t && t <= start + 9.0f && window.getTangentAt(t) != expected) { isWindowExact = false; }
+			}
+			expect(isFieldExact, "field tangents match the section's on the grid");
+			expect(isWindowExact, "window field tangents match the section's within the window");
+		}
+	}
+}
+
+// Points queued to a StrokeProcessor from another thread reach the line in order, and endStroke() returns once all of them are added
+static void checkStrokeProcessor()
+{
+	StrokeProcessor processor(64); // small, so the producer outpaces the processing thread & batches get big
+	for (int numPoints : { 1, 2, 100, 3000 })
+	{
+		const std::vector<Vector2> points = generateStroke(numPoints, 7u + numPoints);
+		const ref<FreeformLine> expected = makeLine(points);
+
+		ref<FreeformLine> line = make_ref<FreeformLine>();
+		line->addPoint(points[0]);
+		processor.beginStroke(line, make_ref<ArcSpline>(line));
+		std::thread producer([&]()
+		{
+			// Retry dropped points, so the line gets all of them
+			for (size_t i = 1; i < points.size(); i++)
+			{
+				while (!processor.addPoint(points[i], InputQueue::getTime())) { std::this_thread::yield(); }
+			}
+		});
+		producer.join();
+		processor.endStroke();
+		expect(hasSamePoints(*line, *expected), "queued points match points added directly");
+	}
+
+	const StrokeProcessor::Stats stats = processor.getStats();
+	expect(stats.queue.numPushed == 1 + 99 + 2999, "every point was queued once");
+}
+
+// Registered checks
+struct Check
+{
+	const char* name;
+	std::function<void()> run;
+};
+
+int main(int argc, char* argv[])
+{
+	const Check checks[] =
+	{
+		{ "PointQueries", checkPointQueries },
+		{ "MomentSegments", checkMomentSegments },
+		{ "StrokeArchive", checkStrokeArchive },
+		{ "SplineCache", checkSplineCache },
+		{ "TangentField", checkTangentField },
+		{ "StrokeProcessor", checkStrokeProcessor },
+	};
+
+	const char* filter = 1 < argc ? argv[1] : "";
+	int numFailedChecks = 0;
+	for (const Check& check : checks)
+	{
+		if (!std::strstr(check.name, filter)) { continue; }
+		g_numFailures = 0;
+		std::printf("%s\n", check.name);
+		check.run();
+		if (g_numFailures) { numFailedChecks++; }
+	}
+
+	std::printf("%d failed\n", numFailedChecks);
+	return numFailedChecks ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+#include "FreeformTool.h"
+#include "ThreadPool.h"
+
+// Index of the worker's own queue for pool threads; -1 for other threads
+static thread_local int t_workerIdx = -1;
+static thread_local const ThreadPool* t_workerPool = nullptr;
+
+ThreadPool::ThreadPool(int numWorkers /*= -1*/) : numQueuedTasks(0), isStopping(false), nextQueue(0)
+{
+	if (numWorkers < 0)
+	{
+		const int numHardwareThreads = (int)std::thread::hardware_concurrency();
+		numWorkers = numHardwareThreads > 1 ? numHardwareThreads - 1 : 0;
+	}
+
+	for (int i = 0; i < numWorkers; i++) { queues.emplace_back(new TaskQueue()); }
+	for (int i = 0; i < numWorkers; i++) { threads.emplace_back(&ThreadPool::runWorker, this, i); }
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		isStopping = true;
+	}
+	wakeCondition.notify_all();
+	for (std::thread& t : threads) { t.join(); }
+}
+
+ThreadPool& ThreadPool::getShared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+void ThreadPool::parallelFor(int count, const std::function<void(int)>& func)
+{
+	if (count <= 0) { return; }
+	if (queues.empty() || count == 1)
+	{
+		std::exception_ptr exception;
+		for (int i = 0; i < count; i++)
+		{
+			try { func(i); }
+			catch (...) { if (!exception) { exception = std::current_exception(); } }
+		}
+		if (exception) { std::rethrow_exception(exception); }
+		return;
+	}
+
+	// Spread tasks over worker queues
+	Batch batch;
+	batch.func = &func;
+	batch.numRemaining = count;
+	for (int i = 0; i < count; i++)
+	{
+		TaskQueue& queue = *queues[nextQueue++ % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.pushBack(Task{ &batch, i });
+	}
+	{
+		std::lock_guard<std::mutex> lock(wakeMutex);
+		numQueuedTasks += count;
+	}
+	wakeCondition.notify_all();
+
+	// Help with tasks of this batch while any are queued, then sleep until the running ones are done
+	const int ownQueue = t_workerPool == this ? t_workerIdx : -1;
+	Task task;
+	while (tryTakeTask(ownQueue, &task, &batch)) { runTask(task); }
+	std::unique_lock<std::mutex> lock(batch.mutex);
+	batch.doneCondition.wait(lock, [&batch] { return 0 == batch.numRemaining; });
+	if (batch.exception) { std::rethrow_exception(batch.exception); }
+}
+
+void ThreadPool::runWorker(int workerIdx)
+{
+	t_workerIdx = workerIdx;
+	t_workerPool = this;
+	for (;;)
+	{
+		Task task;
+		if (tryTakeTask(workerIdx, &task))
+		{
+			runTask(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(wakeMutex);
+		wakeCondition.wait(lock, [this] { return isStopping || numQueuedTasks.load() > 0; });
+		if (isStopping) { return; }
+	}
+}
+
+bool ThreadPool::tryTakeTask(int ownQueue, Task* outTask, const Batch* batch /*= nullptr*/)
+{
+	const int numQueues = (int)queues.size();
+	for (int i = 0; i < numQueues; i++)
+	{
+		// Start with the own queue & take from its back; steal from the front of the others
+		const int queueIdx = ownQueue < 0 ? i : (ownQueue + i) % numQueues;
+		const bool isOwnQueue = queueIdx == ownQueue;
+		TaskQueue& queue = *queues[queueIdx];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.isEmpty()) { continue; }
+		if (batch)
+		{
+			// Nested batches are queued after the outer ones, so search from the back
+			size_t idx = queue.count;
+			while (0 < idx && queue.at(idx - 1).batch != batch) { idx--; }
+			if (0 == idx) { continue; }
+			*outTask = queue.take(idx - 1);
+		}
+		else if (isOwnQueue) { *outTask = queue.popBack(); }
+		else { *outTask = queue.popFront(); }
+		--numQueuedTasks;
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::runTask(const Task& task)
+{
+	Batch& batch = *task.batch;
+	std::exception_ptr exception;
+	try { (*batch.func)(task.idx); }
+	catch (...) { exception = std::current_exception(); }
+
+	// Notify under the lock: the waiting caller may destroy the batch as soon as it's released
+	std::lock_guard<std::mutex> lock(batch.mutex);
+	if (exception && !batch.exception) { batch.exception = exception; }
+	if (0 == --batch.numRemaining) { batch.doneCondition.notify_all(); }
+}
+
+void ThreadPool::TaskQueue::pushBack(const Task& task)
+{
+	if (count == ring.size())
+	{
+		// Unwrap into a ring twice the size
+		std::vector<Task> grown(2 * ring.size());
+		for (size_t i = 0; i < count; i++) { grown[i] = at(i); }
+		ring.swap(grown);
+		first = 0;
+	}
+	ring[(first + count++) & (ring.size() - 1)] = task;
+}
+
+ThreadPool::Task ThreadPool::TaskQueue::popBack()
+{
+	ME_ASSERT(!isEmpty());
+	return at(--count);
+}
+
+ThreadPool::Task ThreadPool::TaskQueue::popFront()
+{
+	ME_ASSERT(!isEmpty());
+	const Task task = at(0);
+	first = (first + 1) & (ring.size() - 1);
+	count--;
+	return task;
+}
+
+ThreadPool::Task ThreadPool::TaskQueue::take(size_t idx)
+{
+	ME_ASSERT(idx < count);
+	const Task task = at(idx);
+	const size_t mask = ring.size() - 1;
+	for (size_t i = idx + 1; i < count; i++) { ring[(first + i - 1) & mask] = at(i); }
+	count--;
+	return task;
+}
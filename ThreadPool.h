@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/* - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
+ThreadPool runs independent tasks on a fixed set of worker threads.
+
+Each worker owns a task deque. It takes its own tasks from the back, and when
+it runs out, it steals from the front of other workers' deques. The thread
+calling parallelFor() helps running tasks of its own call, so nested
+parallelFor() calls from within tasks can't deadlock. It never runs tasks of
+other calls, which could hold it up for an unrelated long job; once none of its
+tasks are queued, it sleeps until the running ones are done.
+
+Deques are ring buffers that only grow, so once they're big enough for the
+largest batches, parallelFor() doesn't allocate.
+
+If func throws, the remaining tasks still run & the first exception is thrown
+from parallelFor() once all of them are done.
+
+With no worker threads (e.g. on a single-core machine), parallelFor() simply
+runs all tasks on the calling thread.
+- - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
+
+// Fixed-size pool of worker threads with per-worker task deques & work stealing.
+class ThreadPool
+{
+public:
+	// Start numWorkers threads; negative value uses one thread less than the number of hardware threads (the caller helps)
+	explicit ThreadPool(int numWorkers = -1);
+
+	// Stop & join all worker threads
+	~ThreadPool();
+
+	// Run func(idx) for every idx in [0, count) & wait until all calls return. Calls may run in any order & concurrently. Rethrows the first exception thrown by func.
+	void parallelFor(int count, const std::function<void(int)>& func);
+
+	// Number of worker threads, not counting threads calling parallelFor()
+	int getNumWorkers() const { return (int)threads.size(); }
+
+	// Pool shared by the whole application
+	static ThreadPool& getShared();
+
+private:
+	// Tasks of a single parallelFor() call
+	struct Batch
+	{
+		const std::function<void(int)>* func;
+
+		// Guards all below; doneCondition is notified when numRemaining drops to 0
+		std::mutex mutex;
+		std::condition_variable doneCondition;
+		int numRemaining;
+		std::exception_ptr exception;
+	};
+
+	// A single call of the batch function
+	struct Task
+	{
+		Batch* batch;
+		int idx;
+	};
+
+	// Task deque owned by a worker; a ring buffer which doubles when it's full
+	struct TaskQueue
+	{
+		TaskQueue() : ring(64), first(0), count(0) { }
+
+		// Is the deque empty
+		bool isEmpty() const { return 0 == count; }
+
+		// Task at idx, counted from the front
+		const Task& at(size_t idx) const { return ring[(first + idx) & (ring.size() - 1)]; }
+
+		// Add a task at the back
+		void pushBack(const Task& task);
+
+		// Take the task at the back or the front
+		Task popBack();
+		Task popFront();
+
+		// Take the task at idx, counted from the front; later tasks move forward
+		Task take(size_t idx);
+
+		std::mutex mutex;
+
+		// Tasks are ring[first], ring[first + 1]... wrapped; the size is a power of two
+		std::vector<Task> ring;
+		size_t first, count;
+	};
+
+	// Worker thread loop
+	void runWorker(int workerIdx);
+
+	// Take a task from the own queue, or steal one from other queues; ownQueue < 0 for non-worker threads. With a batch, only its tasks are taken.
+	bool tryTakeTask(int ownQueue, Task* outTask, const Batch* batch = nullptr);
+
+	// Run a task, keep the exception it throws & mark it done
+	static void runTask(const Task& task);
+
+	// One task queue per worker
+	std::vector<std::unique_ptr<TaskQueue>> queues;
+
+	// Worker threads
+	std::vector<std::thread> threads;
+
+	// Wakes sleeping workers when tasks are queued or the pool stops
+	std::mutex wakeMutex;
+	std::condition_variable wakeCondition;
+	std::atomic<int> numQueuedTasks;
+	bool isStopping;
+
+	// Queue that gets the next task of a parallelFor() call
+	std::atomic<unsigned int> nextQueue;
+};
@@ -2,12 +2,14 @@
 #include "TweakUtil.h"
 
 #include "ArcSpline.h"
+#include "SplineRecomputer.h"
 
-void TweakUtil::attach(ArcSpline* spline, const Vector2& guiAnchorPoint)
+void TweakUtil::attach(ArcSpline* spline, const Vector2& guiAnchorPoint, SplineRecomputer* recomputer /*= nullptr*/)
 {
 	ME_ASSERT(spline);
 
 	this->spline = spline;
+	this->recomputer = recomputer;
 	centerPoint = guiAnchorPoint;
 	initialPoint = centerPoint;
 
@@ -26,8 +28,8 @@ void TweakUtil::attach(ArcSpline* spline, const Vector2& guiAnchorPoint)
 	// Calc where current value sits on the tweak chart
 	// value = orgValue * pow(multiplier, diffOnAxis)
 	// log_multiplier(value/orgValue) = diffOnAxis = log(value/orgValue) / log(multiplier)
-	float startX = std::logf(spline->processingInput->biarcs.maxMeanError / referenceInput.biarcs.maxMeanError) / std::logf(rangeX);
-	float startY = std::logf(spline->processingInput->segments.maxMeanErrorAtReferenceLength / referenceInput.segments.maxMeanErrorAtReferenceLength) / std::logf(rangeY);
+	float startX = std::log(spline->processingInput->biarcs.maxMeanError / referenceInput.biarcs.maxMeanError) / std::log(rangeX);
+	float startY = std::log(spline->processingInput->segments.maxMeanErrorAtReferenceLength / referenceInput.segments.maxMeanErrorAtReferenceLength) / std::log(rangeY);
 	centerPoint -= Vector2(startX, -startY).scale(halfSize);
 
 	tweakables.push_back({ L"Max Mean Spline Error  ", &spline->processingInput->biarcs.maxMeanError, referenceInput.biarcs.maxMeanError, rangeX, 0 });
@@ -37,7 +39,14 @@ void TweakUtil::attach(ArcSpline* spline, const Vector2& guiAnchorPoint)
 
 void TweakUtil::detach()
 {
+	if (spline && recomputer)
+	{
+		// Show the spline for the final parameters
+		recomputer->waitUntilDone();
+		recomputer->applyResult();
+	}
 	spline = nullptr;
+	recomputer = nullptr;
 	wasUpdated = false;
 	tweakables.clear();
 }
@@ -60,5 +69,6 @@ void TweakUtil::update(const Vector2& guiMousePoint)
 	// hand code, allowing extra error for single arcs:
 	spline->processingInput->biarcs.allowExtraToleranceForSingleArcSections = (0.98f < diff.x);
 
-	spline->recreateSpline();
+	if (recomputer) { recomputer->request(spline, *spline->processingInput); }
+	else { spline->recreateSpline(); }
 }
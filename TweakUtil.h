@@ -6,18 +6,19 @@
 #include "Common.h"
 
 class ArcSpline;
+class SplineRecomputer;
 
 // A utility to tweak float parameters; here, hardcoded to control chosen parameters of ArcSpline.
 class TweakUtil
 {
 public:
-	// Attach utility to a spline
-	void attach(ArcSpline* spline, const Vector2& guiAnchorPoint);
+	// Attach utility to a spline; with a recomputer, the spline is recreated on its thread instead of in update()
+	void attach(ArcSpline* spline, const Vector2& guiAnchorPoint, SplineRecomputer* recomputer = nullptr);
 
-	// Detach utility
+	// Detach utility; waits for the recomputer & applies its last result
 	void detach();
 
-	// When isAttached, update the parameters of referenced spline
+	// When isAttached, update the parameters of referenced spline & recreate it, or request recreating it
 	void update(const Vector2& guiMousePoint);
 
 	// Is utility attached to a spline
@@ -33,6 +34,9 @@ protected:
 	// Spline to tweak
 	ref<ArcSpline> spline = nullptr;
 
+	// Recreates the spline asynchronously; null to recreate it in update()
+	SplineRecomputer* recomputer = nullptr;
+
 	// Center point of the tweaking panel
 	Vector2 centerPoint;
 
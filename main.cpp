@@ -1,7 +1,9 @@
 #include "FreeformTool.h"
 
+#include <cstdio>
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <vector>
 
 #define WIN32_LEAN_AND_MEAN // Exclude rarely-used stuff from Windows headers
@@ -11,9 +13,15 @@
 #include <gdiplus.h>
 
 #include "ArcSpline.h"
+#include "BulkLoader.h"
 #include "Common.h"
 #include "FreeformLine.h"
 #include "ShapeDrawer.h"
+#include "SplineCache.h"
+#include "SplineIndex.h"
+#include "SplineRecomputer.h"
+#include "StrokeArchive.h"
+#include "StrokeProcessor.h"
 #include "TweakUtil.h"
 #include "Vector2.h"
 
@@ -26,22 +34,43 @@ This contains the WinMain function & all windows functionality, apart from
 drawing being also performed in ShapeDrawer.
 
 Use mouse + LMB for drawing on the app canvas. You can press C/S/L for clearing,
-saving (and overwriting), and loading the lines. Only input lines are saved.
-ArcSplines are recomputed on load. A single file "lines.dat" is used for storing
-data.
+saving (and overwriting), and loading the lines. Input lines are saved into
+a StrokeArchive "lines.dat"; new lines are appended to it. Text files of older
+versions are imported on load. ArcSplines & their tweaked parameters are saved
+into a SplineCache "splines.dat", and taken from it on load; other ArcSplines
+are recomputed by a BulkLoader, using all cores. Clicked splines are found with a SplineIndex. Press P to toggle the live ArcSpline preview shown while drawing.
+New lines keep all input points unless g_decimationTolerance is set, see
+FreeformLine::decimationTolerance.
+Mouse moves only queue points for a StrokeProcessor, which grows the active line
+& its live spline on its own thread. Tweaked splines are recreated by a
+SplineRecomputer, which drops recomputes made obsolete by newer mouse moves.
 
 See: ArcSpline, FreeformLine,  ShapeDrawer
 - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - */
 
 static ref<FreeformLine> g_activeLine = nullptr;
+static ref<ArcSpline> g_liveSpline = nullptr;
+static bool g_showLiveSpline = true;
 static ref<ArcSpline> g_selectedSpline = nullptr;
 static std::vector<ref<ArcSpline>> g_arcSplines;
+static SplineIndex g_splineIndex; // elements of g_arcSplines, for click-selecting
+static StrokeProcessor* g_strokeProcessor = nullptr; // grows g_activeLine & g_liveSpline; lock its mutex to read the line's points while drawing
+static SplineRecomputer* g_splineRecomputer = nullptr; // recreates the spline being tweaked
+
+// Input points within this distance of the stored line are dropped, see FreeformLine::decimationTolerance; 0 keeps all points, as FreeformLine & FreeformConvert do
+static const float g_decimationTolerance = 0.0f;
 
 static TweakUtil g_tweakUtil;
 bool g_forceDrawAll = false;
 
 const char g_saveFileName[] = "lines.dat";
 
+// Spline results & settings of the saved lines, see SplineCache
+const char g_cacheFileName[] = "splines.dat";
+
+// Number of leading g_arcSplines stored in the save file; -1 if the file has to be rewritten
+static int g_numSavedLines = -1;
+
 using namespace Gdiplus;
 #pragma comment (lib,"Gdiplus.lib")
 
@@ -49,10 +78,13 @@ LRESULT CALLBACK WndProc(HWND, UINT, WPARAM, LPARAM);
 
 VOID OnPaint(HDC hdc)
 {
+	// The stroke processor's lock is only held while reading points of the active line; splines are drawn from snapshots
+	g_splineRecomputer->applyResult();
 	static int nextPartialDrawStart = 0;
-	if (g_activeLine && !g_forceDrawAll)
+	if (g_activeLine && !g_forceDrawAll && !g_liveSpline)
 	{
 		ShapeDrawer drawer(hdc, ShapeDrawer::MODE_FAST_AND_PARTIAL);
+		std::lock_guard<std::mutex> lock(g_strokeProcessor->getMutex());
 		nextPartialDrawStart = drawer.drawFreeformLine(*g_activeLine, nextPartialDrawStart);
 	}
 	else
@@ -66,6 +98,15 @@ VOID OnPaint(HDC hdc)
 		for (const ArcSpline* spline : g_arcSplines) { drawer.drawFreeformLine(*spline->sourceLine); }
 		for (const ArcSpline* spline : g_arcSplines) { drawer.drawArcSpline(*spline, g_selectedSpline == spline ? 3.5f : 2.0f); }
 
+		if (g_liveSpline)
+		{
+			{
+				std::lock_guard<std::mutex> lock(g_strokeProcessor->getMutex());
+				drawer.drawFreeformLine(*g_liveSpline->sourceLine);
+			}
+			drawer.drawArcSpline(*g_liveSpline);
+		}
+
 		if (g_tweakUtil.isActive()) { drawer.drawTweakUtil(g_tweakUtil); }
 	}
 }
@@ -73,65 +114,93 @@ VOID OnPaint(HDC hdc)
 // Clear all lines & cancel drawing
 void globalClear()
 {
+	if (g_activeLine) { g_strokeProcessor->endStroke(); }
 	g_activeLine = nullptr;
+	g_liveSpline = nullptr;
 	g_arcSplines.clear();
+	g_splineIndex.clear();
+	g_numSavedLines = -1;
 }
 
-// Clear all, load FreeformLines from file, regenerate ArcSplines with default parameters.
+// Clear all, load FreeformLines from file, regenerate ArcSplines on all cores. Old text files are imported.
+// Splines stored in the cache are taken from it with their saved parameters; the others are regenerated with default parameters.
 void globalLoad()
 {
 	globalClear();
 
-	std::filebuf fb;
-	if (fb.open(g_saveFileName, std::ios::in))
+	SplineCache cache(g_cacheFileName);
+	BulkLoader loader;
+	loader.cache = &cache;
+	loader.onProgress = [](int numConverted, int numLines)
 	{
-		std::istream is(&fb);
-		int numLines;
-		is >> numLines;
-		for (int i = 0; i < numLines; i++)
+		if (numConverted % 100 == 0 || numConverted == numLines)
 		{
-			ref<FreeformLine> line = new FreeformLine();
-			is >> *line;
-			g_arcSplines.push_back(new ArcSpline(line));
+			char message[64];
+			sprintf_s(message, "Converted %d/%d lines\n", numConverted, numLines);
+			OutputDebugStringA(message);
 		}
+	};
+
+	StrokeArchive archive(g_saveFileName);
+	if (archive.isValid())
+	{
+		loader.load(archive, &g_arcSplines);
+		g_numSavedLines = (int)g_arcSplines.size();
+	}
+	else
+	{
+		std::filebuf fb;
+		if (!fb.open(g_saveFileName, std::ios::in)) { return; }
+		std::istream is(&fb);
+		loader.load(is, &g_arcSplines);
 		fb.close();
 	}
+	for (ArcSpline* spline : g_arcSplines) { g_splineIndex.add(spline); }
+
+	// Report the slowest line, which bounds the scaling
+	double maxSeconds = 0.0;
+	int maxIdx = -1;
+	for (size_t i = 0; i < loader.getStrokeTimings().size(); i++)
+	{
+		if (maxSeconds < loader.getStrokeTimings()[i].convertSeconds) { maxSeconds = loader.getStrokeTimings()[i].convertSeconds; maxIdx = (int)i; }
+	}
+	char message[160];
+	sprintf_s(message, "Loaded %d lines: reading %.1f ms, conversion %.1f ms, slowest line #%d %.1f ms\n", (int)g_arcSplines.size(), loader.getParseSeconds() * 1000.0, loader.getConvertSeconds() * 1000.0, maxIdx, maxSeconds * 1000.0);
+	OutputDebugStringA(message);
 }
 
-// Save all created FreeformLines to a file. Don't save ArcSplines, or their modified parametes.
+// Save all created FreeformLines to a file, and the ArcSplines with their parameters to the cache.
+// Lines added since the last save or load are appended; all lines are rewritten after clearing or importing text, or if appending fails.
 void globalSave()
 {
-	std::filebuf fb;
-	if (fb.open(g_saveFileName, std::ios::out))
+	// Let a tweaked spline catch up with its parameters
+	g_splineRecomputer->waitUntilDone();
+	g_splineRecomputer->applyResult();
+
+	std::vector<const FreeformLine*> lines;
+	bool isSaved = false;
+	if (0 <= g_numSavedLines)
 	{
-		std::ostream os(&fb);
-		os << g_arcSplines.size() << " ";
-		for (const ref<ArcSpline>& s : g_arcSplines) { os << *s->sourceLine; }
-		fb.close();
+		for (size_t i = g_numSavedLines; i < g_arcSplines.size(); i++) { lines.push_back(g_arcSplines[i]->sourceLine); }
+		isSaved = StrokeArchive::append(g_saveFileName, lines);
 	}
+
+	// Rewrite all lines if appending isn't possible
+	if (!isSaved)
+	{
+		lines.clear();
+		for (const ArcSpline* spline : g_arcSplines) { lines.push_back(spline->sourceLine); }
+		isSaved = StrokeArchive::write(g_saveFileName, lines);
+	}
+	g_numSavedLines = isSaved ? (int)g_arcSplines.size() : -1;
+	if (isSaved) { SplineCache::write(g_cacheFileName, g_arcSplines); }
 }
 
 // Find the latest ArcSpline within a distance from a point. Also note if we're hitting an endpoint of an element.
 ArcSpline* globalFindLatestElementInDistance(const Vector2& point, bool* outIsEndpointHit, float maxDist = 5.0f, float testDistForEndpoints = 5.0f)
 {
-	// process splines and elements starting at the latest, for intuitive selection
-	*outIsEndpointHit = false;
-	for (auto it = g_arcSplines.rbegin(); it != g_arcSplines.rend(); ++it)
-	{
-		std::vector<ref<SplineElement>>& elements = (*it)->displayShapes;
-		
-		for (auto elemIt = elements.rbegin(); elemIt != elements.rend(); ++elemIt)
-		{
-			const SplineElement& elem = **elemIt;
-			float dist = elem.distTo(point);
-			if (dist <= maxDist)
-			{
-				*outIsEndpointHit = elem.distToEndPoint(point) <= testDistForEndpoints;
-				return *it;
-			}
-		}
-	}
-	return nullptr;
+	// The latest spline & element win, for intuitive selection
+	return g_splineIndex.findLatestElementInDistance(point, outIsEndpointHit, maxDist, testDistForEndpoints);
 }
 
 INT WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, PSTR, INT iCmdShow)
@@ -175,6 +244,14 @@ INT WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, PSTR, INT iCmdShow)
 		hInstance,                // program instance handle
 		NULL);                    // creation parameters
 
+	// Redraw after the processing thread added points
+	g_strokeProcessor = new StrokeProcessor();
+	g_strokeProcessor->onUpdate = [hWnd]() { InvalidateRect(hWnd, NULL, false); };
+
+	// Redraw after a tweaked spline was recreated
+	g_splineRecomputer = new SplineRecomputer();
+	g_splineRecomputer->onResult = [hWnd]() { InvalidateRect(hWnd, NULL, false); };
+
 	ShowWindow(hWnd, iCmdShow);
 	UpdateWindow(hWnd);
 
@@ -185,6 +262,8 @@ INT WINAPI WinMain(HINSTANCE hInstance, HINSTANCE, PSTR, INT iCmdShow)
 	}
 
 	ME_ON_DEBUG(globalClear());
+	delete g_splineRecomputer;
+	delete g_strokeProcessor;
 	GdiplusShutdown(gdiplusToken);
 	return msg.wParam;
 }  // WinMain
@@ -200,8 +279,8 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message,
 	case WM_MOUSEMOVE:
 		if (g_activeLine)
 		{
-			// Append point to line
-			g_activeLine->addPoint(Vector2(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)));
+			// Queue point for the processing thread, which appends it to the line & redraws
+			g_strokeProcessor->addPoint(Vector2(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)), InputQueue::getTime());
 
 			// When drawing starts, unselect the hightlighted spline, and redraw all
 			if (g_selectedSpline)
@@ -210,10 +289,11 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message,
 				g_forceDrawAll = true; 
 			}
 
-			InvalidateRect(hWnd, NULL, false);
+			if (g_forceDrawAll) { InvalidateRect(hWnd, NULL, false); }
 		}
 		if (g_tweakUtil.isAttached())
 		{
+			// Moves the panel now; the spline is redrawn again once the recomputer has it
 			g_tweakUtil.update(Vector2(GET_X_LPARAM(lParam), GET_Y_LPARAM(lParam)));
 			InvalidateRect(hWnd, NULL, false);
 		}
@@ -236,7 +316,7 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message,
 			if (g_selectedSpline && !isEndpoint)
 			{
 				// Edit the found shape
-				g_tweakUtil.attach(g_selectedSpline, clickPoint);
+				g_tweakUtil.attach(g_selectedSpline, clickPoint, g_splineRecomputer);
 			}
 			else
 			{
@@ -244,26 +324,41 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message,
 				//
 				// Start drawing a new shape
 				g_activeLine = new FreeformLine();
+				g_activeLine->decimationTolerance = g_decimationTolerance;
 				g_activeLine->addPoint(clickPoint);
+				if (g_showLiveSpline) { g_liveSpline = new ArcSpline(g_activeLine); }
+				g_strokeProcessor->beginStroke(g_activeLine, g_liveSpline);
 			}
 		}
 		return 0;
 	case WM_LBUTTONUP:
+	{
+		if (g_activeLine) { g_strokeProcessor->endStroke(); }
 		if (g_activeLine && 0.0f < g_activeLine->length()) 
 		{
-			// Create a new ArcSpline
-			g_arcSplines.push_back(new ArcSpline(g_activeLine)); 
+			// Create a new ArcSpline; the live spline is only a preview
+			g_arcSplines.push_back(make_ref<ArcSpline>(g_activeLine));
+			g_splineIndex.add(g_arcSplines.back());
 		}
-		g_activeLine = nullptr;
+		const bool wasTweaked = g_tweakUtil.isActive();
 		g_tweakUtil.detach();
+		if (wasTweaked)
+		{
+			// Tweaking recreated the selected spline; detaching applied its final shapes
+			g_splineIndex.update(g_selectedSpline);
+		}
+		g_activeLine = nullptr;
+		g_liveSpline = nullptr;
 		InvalidateRect(hWnd, NULL, false);
 		return 0;
+	}
 	case WM_KEYDOWN:
 		switch (wParam)
 		{
 		case 'C': globalClear(); break;
 		case 'L': globalLoad(); break;
 		case 'S': globalSave(); break;
+		case 'P': g_showLiveSpline = !g_showLiveSpline; break;
 		}
 		InvalidateRect(hWnd, NULL, false);
 		return 0;